@@ -0,0 +1,25 @@
+# Turns a SPIR-V binary into a header holding an aligned constexpr uint32_t array.
+# Usage: cmake -DINPUT=<file.spv> -DOUTPUT=<file.hpp> -DSYMBOL=<name> -P EmbedSpirv.cmake
+
+file(READ ${INPUT} hex HEX)
+string(LENGTH "${hex}" hex_length)
+math(EXPR remainder "${hex_length} % 8")
+if(NOT remainder EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a whole number of SPIR-V words")
+endif()
+
+# glslc writes words in little-endian order, so swap each group of four bytes into a literal.
+string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])"
+       "0x\\4\\3\\2\\1," words "${hex}")
+string(REGEX REPLACE "(0x[0-9a-f]+,0x[0-9a-f]+,0x[0-9a-f]+,0x[0-9a-f]+,0x[0-9a-f]+,0x[0-9a-f]+,0x[0-9a-f]+,0x[0-9a-f]+,)"
+       "\\1\n    " words "${words}")
+string(STRIP "${words}" words)
+
+file(WRITE ${OUTPUT}
+"#pragma once\n"
+"// Generated from ${INPUT}, do not edit.\n"
+"#include <cstdint>\n"
+"\n"
+"alignas(4) inline constexpr uint32_t ${SYMBOL}[] = {\n"
+"    ${words}\n"
+"};\n")
@@ -1,2 +0,0 @@
-glslc ./shader/shader.vert -o ./shader/binary/vert.spv
-glslc ./shader/shader.frag -o ./shader/binary/frag.spv
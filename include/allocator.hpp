@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vk.hpp>
+#include <toolkits.hpp>
+#include <array>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Sub-allocates buffers and images out of large vk::DeviceMemory blocks instead of calling
+// vkAllocateMemory per resource. Long-lived resources come from best-fit free lists; per-frame
+// data comes from a RingAllocator on top of one host-visible buffer.
+//
+// Buffers (and linear images) and optimal-tiling images never share a block, which keeps
+// bufferImageGranularity conflicts impossible without per-neighbour page checks.
+enum class ResourceKind : uint32_t {
+    Linear,
+    Optimal
+};
+
+struct Allocation {
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    // Host-visible blocks stay persistently mapped; this already includes the offset.
+    void* mapped = nullptr;
+
+    // Bookkeeping for free(): the block and the free-list range the allocation consumed.
+    uint32_t block = ~0u;
+    vk::DeviceSize range_offset = 0;
+    vk::DeviceSize range_size = 0;
+};
+
+struct AllocatedBuffer {
+    vk::Buffer buffer;
+    Allocation allocation;
+};
+
+struct AllocatedImage {
+    vk::Image image;
+    Allocation allocation;
+};
+
+struct AllocatorStats {
+    vk::DeviceSize reserved_bytes = 0;   // sum of all block sizes
+    vk::DeviceSize used_bytes = 0;       // requested by live allocations
+    vk::DeviceSize wasted_bytes = 0;     // alignment padding in front of live allocations
+    vk::DeviceSize free_bytes = 0;
+    vk::DeviceSize largest_free_range = 0;
+    uint32_t block_count = 0;
+    uint32_t allocation_count = 0;
+    // 0 when all free memory is one range, approaching 1 as it splinters.
+    double fragmentation = 0.0;
+};
+
+// Best-fit free list over one block, coalescing neighbouring ranges on release.
+class FreeList {
+public:
+    explicit FreeList(vk::DeviceSize size);
+
+    // Returns false when no range can hold size bytes at the requested alignment.
+    bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, 
+                  vk::DeviceSize& offset, vk::DeviceSize& range_offset, vk::DeviceSize& range_size);
+    void release(vk::DeviceSize range_offset, vk::DeviceSize range_size);
+
+    vk::DeviceSize free_bytes() const { return m_free_bytes; }
+    vk::DeviceSize largest_free_range() const;
+    bool empty() const;
+
+private:
+    vk::DeviceSize m_size;
+    vk::DeviceSize m_free_bytes;
+    std::map<vk::DeviceSize, vk::DeviceSize> m_ranges;
+};
+
+class GpuAllocator {
+public:
+    // Runs before every allocation, outside the allocator's lock, with the heap and size about to
+    // be allocated. It may free memory through this allocator but must not allocate from it.
+    using BudgetCheck = std::function<void(uint32_t heap, vk::DeviceSize size)>;
+
+    void init(const vk::Device& device, const DeviceCapabilities& caps);
+    void destroy();
+
+    Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties,
+                        ResourceKind kind);
+    void free(const Allocation& allocation);
+
+    AllocatedBuffer create_buffer(const vk::BufferCreateInfo& create_info, vk::MemoryPropertyFlags properties);
+    void destroy_buffer(const AllocatedBuffer& buffer);
+    AllocatedImage create_image(const vk::ImageCreateInfo& create_info, vk::MemoryPropertyFlags properties);
+    void destroy_image(const AllocatedImage& image);
+
+    AllocatorStats stats() const;
+    const vk::PhysicalDeviceMemoryProperties& memory_properties() const { return m_memory_properties; }
+    // Device memory currently allocated from heap, i.e. the size of its live blocks.
+    vk::DeviceSize reserved_bytes(uint32_t heap) const;
+
+    // Set while no other thread allocates; an empty check disables it.
+    void set_budget_check(BudgetCheck check) { m_budget_check = std::move(check); }
+    // Frees the empty shared blocks of heap that are otherwise kept for reuse. Returns the bytes freed.
+    vk::DeviceSize trim(uint32_t heap);
+
+private:
+    struct Block {
+        vk::DeviceMemory memory;
+        vk::DeviceSize size = 0;
+        uint32_t memory_type = 0;
+        ResourceKind kind = ResourceKind::Linear;
+        bool dedicated = false;
+        void* mapped = nullptr;
+        FreeList free_list{ 0 };
+        vk::DeviceSize used_bytes = 0;
+        vk::DeviceSize wasted_bytes = 0;
+        uint32_t allocation_count = 0;
+    };
+
+    vk::DeviceSize block_size_for(uint32_t memory_type) const;
+    uint32_t create_block(uint32_t memory_type, ResourceKind kind, vk::DeviceSize size, bool dedicated);
+    void release_block(uint32_t index);
+
+    vk::Device m_device;
+    vk::PhysicalDeviceMemoryProperties m_memory_properties;
+    uint32_t m_max_allocation_count = 0;
+    uint32_t m_device_allocation_count = 0;
+    std::vector<Block> m_blocks;
+    std::vector<uint32_t> m_free_block_slots;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> m_heap_reserved{};
+    BudgetCheck m_budget_check;
+    mutable std::mutex m_mutex;
+};
+
+struct RingAllocation {
+    vk::Buffer buffer;
+    vk::DeviceSize offset = 0;
+    void* mapped = nullptr;
+};
+
+// Per-frame bump allocator over one persistently mapped buffer. Space handed out during a frame
+// is reclaimed once that frame slot comes around again, i.e. after its fence has been waited on.
+class RingAllocator {
+public:
+    void init(GpuAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, uint32_t frames_in_flight);
+    void destroy(GpuAllocator& allocator);
+
+    void begin_frame(uint32_t frame_index);
+    RingAllocation allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+    vk::DeviceSize used_bytes() const { return m_head - m_tail; }
+    // Alignment padding and skipped tail space at wrap-around, accumulated since init.
+    vk::DeviceSize wasted_bytes() const { return m_wasted; }
+    vk::DeviceSize capacity() const { return m_size; }
+
+private:
+    AllocatedBuffer m_buffer;
+    vk::DeviceSize m_size = 0;
+    // Monotonic positions; the physical offset is position % m_size.
+    vk::DeviceSize m_head = 0;
+    vk::DeviceSize m_tail = 0;
+    vk::DeviceSize m_wasted = 0;
+    std::vector<vk::DeviceSize> m_frame_end;
+    uint32_t m_current_frame = ~0u;
+};
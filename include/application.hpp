@@ -1,12 +1,123 @@
 #pragma once
 
 #include <vk.hpp>
+#include <toolkits.hpp>
+#include <pipeline_cache.hpp>
+#include <shader_pack.hpp>
+#include <pipeline_builder.hpp>
+#include <thread_pool.hpp>
+#include <allocator.hpp>
+#include <upload.hpp>
+#include <geometry.hpp>
+#include <culling.hpp>
+#include <bindless.hpp>
+#include <render_graph.hpp>
+#include <readback.hpp>
+#include <deletion_queue.hpp>
+#include <memory_budget.hpp>
+#include <gpu_tasks.hpp>
+#include <shader_reload.hpp>
+#include <latency.hpp>
+#include <parallel_recorder.hpp>
+#include <profiler.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <iostream>
 #include <optional>
+#include <unordered_map>
+#include <chrono>
 
+// headless skips GLFW entirely. The renderer then draws into a VK_EXT_headless_surface
+// swapchain when the instance offers one, otherwise into device-owned offscreen images.
+struct ApplicationConfig {
+    bool headless = false;
+    bool use_headless_surface = true;
+    uint32_t width = 800;
+    uint32_t height = 600;
+    uint32_t offscreen_image_count = 3;
+    // Falls back to FIFO when the surface lacks the mode. 0 images means minImageCount + 1.
+    // Both can be changed at runtime, see Application::set_present_mode().
+    vk::PresentModeKHR present_mode = vk::PresentModeKHR::eMailbox;
+    uint32_t swapchain_image_count = 0;
+    uint32_t frames_in_flight = 2;
+    // 0 renders until the window closes; headless runs fall back to 1000 frames.
+    uint32_t max_frames = 0;
+    // Empty disables the on-disk pipeline cache.
+    std::string pipeline_cache_path = "pipeline_cache.bin";
+    // Directory of <name>.spv files to map instead of the SPIR-V embedded at build time.
+    std::string shader_pack_path;
+    // Also compiles every PipelineVariant::permutations() entry at startup.
+    bool compile_pipeline_permutations = false;
+    // Restrict device selection to one enumeration index or to names containing device_name.
+    int device_index = -1;
+    std::string device_name;
+    // Instances in the scene, split across draw_count indirect draws, and the worker threads
+    // recording those draws (0 records inline).
+    uint32_t instance_count = 1;
+    uint32_t draw_count = 1;
+    uint32_t record_threads = 0;
+    // Frustum-culls every instance in a compute pass and draws the survivors indirectly.
+    // A frustum scale below 1 shrinks the culling frustum inside the viewport, which makes
+    // the culling visible.
+    bool gpu_culling = false;
+    float cull_frustum_scale = 1.0f;
+    // Workgroup size of the cull shader, applied through a specialization constant.
+    uint32_t cull_group_size = 64;
+    // Renders with vkCmdBeginRendering and extended dynamic state instead of a render pass,
+    // framebuffers and baked pipeline permutations (Vulkan 1.3).
+    bool dynamic_rendering = false;
+    // Copies every rendered frame back to host memory. readback_consumer receives each frame on a
+    // worker thread, readback_latency frames after it was submitted; without one, a non-empty
+    // readback_path writes <readback_path>_<frame>.<format> files instead.
+    ReadbackConsumer readback_consumer;
+    std::string readback_path;
+    ReadbackFileFormat readback_format = ReadbackFileFormat::Ppm;
+    uint32_t readback_latency = 2;
+    // Chrome trace JSON written on shutdown; empty disables the export.
+    std::string trace_path;
+    // Recompiles shaders in shader_source_dir with shader_compiler whenever they change and swaps
+    // the affected pipelines in between frames. Empty paths use the ones the build used.
+    bool hot_reload = false;
+    std::string shader_source_dir;
+    std::string shader_compiler;
+    // Caps the budget of device-local heaps below what the driver reports; 0 keeps the driver's.
+    vk::DeviceSize memory_budget_limit = 0;
+    // Validation messages below this severity are counted but not printed.
+    vk::DebugUtilsMessageSeverityFlagBitsEXT validation_min_printed = vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning;
+};
+
+// Everything one frame in flight owns, so recording frame N+1 never touches frame N.
+struct FrameContext {
+    vk::CommandPool command_pool;
+    vk::CommandBuffer command_buffer;
+    vk::Semaphore image_available;
+    vk::Fence in_flight;
+    bool submitted = false;
+    uint64_t upload_wait_value = 0;
+    // Latency sample completed by this frame's fence when present wait is unavailable.
+    uint64_t latency_id = 0;
+};
+
+// Averaged over the last reporting window (one second), or over the whole run for run_stats().
+struct FrameStats {
+    uint64_t frames = 0;
+    double fps = 0.0;
+    double cpu_ms = 0.0;
+    double record_ms = 0.0;
+    double gpu_ms = 0.0;
+};
+
+struct InitStageTime {
+    const char* name;
+    double ms;
+};
 
 class Application {
 public:
+    Application() = default;
+    explicit Application(const ApplicationConfig& config);
+
     void run();
     void init();
     void init_vulkan();
@@ -14,16 +125,75 @@ public:
     void mainloop();
     void cleanup();
 
+    // Take effect by recreating the swapchain before the next frame. In a window, keys 1-4
+    // select FIFO, FIFO_RELAXED, MAILBOX and IMMEDIATE, and +/- change the image count.
+    void set_present_mode(vk::PresentModeKHR mode);
+    void set_swapchain_image_count(uint32_t count);
+
+    const FrameStats& frame_stats() const { return m_stats; }
+    const FrameStats& run_stats() const { return m_run_stats; }
+    FrameTimeStats frame_time_stats() const { return m_profiler.frame_time_stats(); }
+    PipelineStatistics pipeline_statistics() const { return m_profiler.pipeline_statistics(); }
+    // Wall time of each init_vulkan() stage from the last init, in execution order.
+    const std::vector<InitStageTime>& init_stage_times() const { return m_init_stage_times; }
+    CullStats cull_stats() const { return m_culler.stats(); }
+    AllocatorStats memory_stats() const { return m_allocator.stats(); }
+    // Per-heap usage and budget as of the last frame. Eviction handlers added here run when a heap
+    // nears its budget; add them before the first frame.
+    MemoryBudget& memory_budget() { return m_memory_budget; }
+    std::vector<LatencyStats> latency_stats() const { return m_latency.stats(); }
+    uint64_t readback_frames() const { return m_readback.delivered(); }
+    // Coroutine tasks on the worker pool that can co_await GPU timelines and fences.
+    TaskScheduler& tasks() { return m_tasks; }
+    DeletionStats deletion_stats() const { return m_deletion_queue.stats(); }
+    // The live pipeline a variant compiled to, or null when it was not built.
+    vk::Pipeline pipeline(const PipelineVariant& variant) const;
+    // Destroys handle once every frame recorded so far has finished on the GPU, without waiting.
+    void retire(DeferredHandle handle) { m_deletion_queue.retire(std::move(handle), m_frame_number); }
+    // All zero when validation is off.
+    DebugMessageCounts debug_message_counts() const { return m_debug_sink ? m_debug_sink->counts() : DebugMessageCounts{}; }
+
 private:
     void create_instance();
+    void create_window();
     void setup_debugger();
     void select_physical_device();
     void create_device();
     void create_surface();
     void create_swapchain();
+    void recreate_swapchain();
+    void create_offscreen_images();
     void create_image_view();
     void create_render_pass();
+    void load_shaders();
+    void create_pipeline_cache();
+    void create_descriptors();
     void create_pipeline();
+    PipelineShaders create_scene_shaders(std::span<const uint32_t> vertex, std::span<const uint32_t> fragment) const;
+    void install_pipelines(const std::vector<PipelineBuildResult>& results, uint64_t shaders_hash,
+                           const PipelineVariant& scene_variant);
+    std::vector<PipelineVariant> pipeline_variants() const;
+    void start_shader_reload();
+    void snapshot_reload_target();
+    void rebuild_pipelines(const ShaderChanges& changed);
+    void swap_reloaded_pipelines();
+    void create_framebuffers();
+    void create_frames();
+    void create_present_semaphores();
+    void create_geometry();
+    void create_frame_graph();
+
+    bool should_stop() const;
+    void draw_frame();
+    void record_command_buffer(FrameContext& frame, uint32_t frame_index, uint32_t image_index);
+    void record_cull_pass(const vk::CommandBuffer& cmd, uint32_t frame_index);
+    void record_main_pass(const vk::CommandBuffer& cmd, uint32_t frame_index, uint32_t image_index);
+    void record_readback(const vk::CommandBuffer& cmd, uint32_t image_index, vk::ImageLayout layout);
+    void begin_rendering(const vk::CommandBuffer& cmd, uint32_t image_index, bool secondaries);
+    void end_rendering(const vk::CommandBuffer& cmd);
+    void record_draws(const vk::CommandBuffer& cmd, uint32_t first_draw, uint32_t draw_count);
+    void update_stats(double cpu_ms, double record_ms);
+    void poll_latency();
 
 
     // vk::SurfaceFormatKHR choose_surface_format(const std::vector<vk::SurfaceFormatKHR>& formats);
@@ -31,19 +201,123 @@ private:
     // vk::Extent2D choose_extent(const vk::SurfaceCapabilitiesKHR& capabilities);
 
 
-    GLFWwindow* m_window;
+    ApplicationConfig m_config;
+    GLFWwindow* m_window = nullptr;
     vk::Instance m_inst;
     vk::DebugUtilsMessengerEXT m_db_messenger;
+    // Outlives the instance: the layers report through it until vkDestroyInstance returns.
+    std::unique_ptr<DebugMessageSink> m_debug_sink;
     vk::PhysicalDevice m_phy_device = VK_NULL_HANDLE;
+    DeviceCapabilities m_caps;
     vk::Device m_device;
+    GpuAllocator m_allocator;
+    MemoryBudget m_memory_budget;
+    DeletionQueue m_deletion_queue;
+    UploadService m_uploads;
     vk::Queue m_queue;
+    vk::Queue m_present_queue;
+    uint32_t m_graphics_family = 0;
+    vk::Queue m_compute_queue;
+    vk::Queue m_transfer_queue;
+    uint32_t m_compute_family = 0;
+    uint32_t m_transfer_family = 0;
     vk::SurfaceKHR m_surface;
     vk::SwapchainKHR m_swapchain;
+    vk::PresentModeKHR m_present_mode = vk::PresentModeKHR::eFifo;
+    bool m_swapchain_dirty = false;
     vk::Format m_format;
     vk::Extent2D m_extent;
     std::vector<vk::Image> m_images;
+    std::vector<AllocatedImage> m_offscreen_images;
     std::vector<vk::ImageView> m_image_views;
     vk::RenderPass m_render_pass;
-    vk::PipelineLayout m_pipeline_layout;
-    vk::Pipeline m_pipeline;
+    bool m_dynamic_rendering = false;
+    PipelineCache m_pipeline_cache;
+    std::unique_ptr<ShaderPack> m_shader_pack;
+    std::span<const uint32_t> m_vert_shader;
+    std::span<const uint32_t> m_frag_shader;
+    // Owns the pipeline layout every pipeline is built against.
+    BindlessDescriptors m_bindless;
+    // Records the dynamic rendering path; the render pass path keeps its own subpass dependencies.
+    RenderGraph m_frame_graph;
+    RenderGraph::ResourceId m_graph_target = 0;
+    uint32_t m_graph_frame_index = 0;
+    uint32_t m_graph_image_index = 0;
+    FrameReadback m_readback;
+    // Every live graphics pipeline by PipelineVariant::key(); the keys are hashes already. The
+    // frame draws the scene variant, looked up here like any other.
+    struct IdentityHash {
+        size_t operator()(uint64_t key) const { return static_cast<size_t>(key); }
+    };
+    std::unordered_map<uint64_t, vk::Pipeline, IdentityHash> m_pipeline_lookup;
+    uint64_t m_shaders_hash = 0;
+    PipelineVariant m_scene_variant;
+
+    // Built on the reloader's thread and published with one atomic exchange; the render thread
+    // takes them at the next frame boundary. Null members were not affected by the change.
+    struct ReloadedPipelines {
+        std::vector<PipelineBuildResult> graphics;
+        uint64_t shaders_hash = 0;
+        // What graphics were built against; dropped at swap time when that has changed since.
+        vk::RenderPass render_pass;
+        vk::Format format = vk::Format::eUndefined;
+        PipelineVariant scene_variant;
+        vk::Pipeline cull;
+    };
+    // The render thread's variants and targets as of the last (re)creation. Rebuilds copy it under
+    // the lock instead of reading members the render thread may be writing.
+    struct ReloadTarget {
+        std::vector<PipelineVariant> variants;
+        vk::RenderPass render_pass;
+        vk::Format format = vk::Format::eUndefined;
+    };
+    std::mutex m_reload_target_mutex;
+    ReloadTarget m_reload_target;
+    // Compiles rebuilds on a few threads of their own, so a burst of saves can't take over the
+    // shared pool that readback consumers and tasks run on. Outlives the reloader's thread.
+    std::unique_ptr<ThreadPool> m_reload_pool;
+    ShaderReloader m_shader_reloader;
+    // Reloader thread only: the latest SPIR-V of every shader compiled since startup.
+    ShaderChanges m_reloaded_spirv;
+    std::atomic<ReloadedPipelines*> m_reloaded_pipelines{ nullptr };
+    ThreadPool m_thread_pool;
+    TaskScheduler m_tasks;
+    std::vector<vk::Framebuffer> m_framebuffers;
+    GeometryBatch m_geometry;
+    GpuCuller m_culler;
+    Frustum m_cull_frustum;
+
+    std::vector<FrameContext> m_frames;
+    std::vector<vk::Fence> m_images_in_flight;
+    // Signaled by the submit that renders an image and waited on by its present. One per swapchain
+    // image: a frame slot's semaphore may still be held by the present of a different image.
+    std::vector<vk::Semaphore> m_render_finished;
+    // Reaches n + 1 once frame n has finished on the GPU; readback deliveries await it.
+    vk::Semaphore m_frame_timeline;
+    uint64_t m_frame_number = 0;
+    std::unique_ptr<WorkStealingScheduler> m_record_scheduler;
+    ParallelRecorder m_recorder;
+
+    Profiler m_profiler;
+    std::vector<InitStageTime> m_init_stage_times;
+
+    using Clock = std::chrono::steady_clock;
+    FrameStats m_stats;
+    Clock::time_point m_window_start;
+    uint64_t m_window_frames = 0;
+    double m_window_cpu_ms = 0.0;
+    double m_window_record_ms = 0.0;
+    double m_window_gpu_ms = 0.0;
+    uint64_t m_window_gpu_samples = 0;
+    FrameStats m_run_stats;
+    double m_run_cpu_ms = 0.0;
+    double m_run_record_ms = 0.0;
+    double m_run_gpu_ms = 0.0;
+    uint64_t m_run_gpu_samples = 0;
+
+
+    LatencyTracker m_latency;
+    bool m_present_wait = false;
+    uint64_t m_present_id = 0;
+    Clock::time_point m_input_time;
 };
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vk.hpp>
+#include <toolkits.hpp>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Hands out stable slots in [0, capacity). Released slots are reused before fresh ones, most
+// recently released first.
+class IndexAllocator {
+public:
+    explicit IndexAllocator(uint32_t capacity = 0) : m_capacity(capacity) {}
+
+    // Throws once every slot is taken.
+    uint32_t allocate();
+    void release(uint32_t index);
+
+    uint32_t capacity() const { return m_capacity; }
+    uint32_t size() const { return m_next - static_cast<uint32_t>(m_free.size()); }
+
+private:
+    uint32_t m_capacity;
+    uint32_t m_next = 0;
+    std::vector<uint32_t> m_free;
+};
+
+// Matches the bindings of the bindless set in the shaders.
+enum class BindlessBinding : uint32_t {
+    StorageBuffer = 0,
+    SampledImage = 1,
+    Sampler = 2
+};
+
+// One large update-after-bind descriptor set of storage buffers, sampled images and samplers,
+// plus the single pipeline layout every pipeline in the application is built against. Resources
+// are registered once and addressed from shaders by the index they got back, passed in push
+// constants, so recording binds the set once per command buffer and never switches layouts.
+//
+// Without the descriptor indexing features the set is not created and the layout only carries
+// the push constant range.
+class BindlessDescriptors {
+public:
+    // The guaranteed minimum of maxPushConstantsSize, shared by all stages.
+    static constexpr uint32_t push_constant_size = 128;
+    static constexpr vk::ShaderStageFlags push_constant_stages = vk::ShaderStageFlagBits::eVertex
+                                                               | vk::ShaderStageFlagBits::eFragment
+                                                               | vk::ShaderStageFlagBits::eCompute;
+
+    // Runtime arrays, partially bound, update-after-bind and update-unused-while-pending for
+    // storage buffers and sampled images, and dynamic indexing of both.
+    static bool supported(const DeviceCapabilities& caps);
+
+    void init(const vk::Device& device, const DeviceCapabilities& caps);
+    void destroy();
+
+    bool enabled() const { return static_cast<bool>(m_set); }
+    vk::PipelineLayout layout() const { return m_layout; }
+
+    // Thread-safe. The descriptor is written immediately; releasing is only safe once no frame in
+    // flight can still read the index.
+    uint32_t add_storage_buffer(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE);
+    uint32_t add_sampled_image(vk::ImageView view, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+    uint32_t add_sampler(vk::Sampler sampler);
+    void release(BindlessBinding binding, uint32_t index);
+
+    // Binds the set for the bind point; a no-op without descriptor indexing.
+    void bind(const vk::CommandBuffer& cmd, vk::PipelineBindPoint bind_point) const;
+    void push_constants(const vk::CommandBuffer& cmd, const void* data, uint32_t size) const;
+
+    uint32_t capacity(BindlessBinding binding) const { return m_indices[static_cast<uint32_t>(binding)].capacity(); }
+    uint32_t size(BindlessBinding binding) const;
+
+private:
+    uint32_t allocate(BindlessBinding binding);
+    void write(const vk::WriteDescriptorSet& write);
+
+    vk::Device m_device;
+    vk::DescriptorSetLayout m_set_layout;
+    vk::DescriptorPool m_pool;
+    vk::DescriptorSet m_set;
+    vk::PipelineLayout m_layout;
+
+    IndexAllocator m_indices[3];
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <upload.hpp>
+#include <toolkits.hpp>
+#include <bindless.hpp>
+#include <pipeline_state.hpp>
+#include <array>
+#include <span>
+#include <utility>
+#include <vector>
+
+// One cullable object: a bounding sphere and the indexed draw that renders it as one instance.
+// Layout matches CullObject in cull.comp.
+struct CullObject {
+    float sphere[4];
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t instance;
+};
+
+// Normalized planes (xyz normal, w distance) with the inside on the positive side.
+struct Frustum {
+    std::array<std::array<float, 4>, 6> planes;
+
+    // Extracts the planes of a column-major view-projection matrix with Vulkan's [0, 1] depth.
+    static Frustum from_view_projection(const std::array<float, 16>& m);
+};
+
+struct CullStats {
+    uint64_t tested = 0;
+    uint64_t drawn = 0;
+};
+
+// Frustum culling on the GPU. A compute pass tests every object's bounding sphere and writes
+// one indirect command per survivor, compacted behind an atomic counter that the graphics pass
+// consumes with vkCmdDrawIndexedIndirectCount. Without drawIndirectCount, or with more objects
+// than maxDrawIndirectCount, the commands stay in place and culled objects get an instance count
+// of 0 instead. The tested/drawn counters are
+// copied back per frame in flight. The buffers are reached through the bindless set, so the
+// pass shares the application's pipeline layout.
+class GpuCuller {
+public:
+    // Created from create_pipeline() next to the graphics pipelines, so it shares the cache.
+    void create_pipeline(const vk::Device& device, const vk::PipelineCache& cache, const BindlessDescriptors& bindless,
+                         uint32_t group_size);
+    // Builds the pipeline from other cull.comp SPIR-V without touching the live one. Any thread.
+    vk::Pipeline build_pipeline(const vk::PipelineCache& cache, const BindlessDescriptors& bindless,
+                                std::span<const uint32_t> code) const;
+    // Installs pipeline for the next record() and returns the previous one to retire.
+    vk::Pipeline replace_pipeline(vk::Pipeline pipeline) { return std::exchange(m_pipeline, pipeline); }
+    void init(const DeviceCapabilities& caps, GpuAllocator& allocator, UploadService& uploads, BindlessDescriptors& bindless,
+              std::span<const CullObject> objects, uint32_t frames_in_flight);
+    void destroy(GpuAllocator& allocator);
+
+    bool enabled() const { return m_object_count > 0; }
+
+    // Records the cull dispatch with the bindless set bound. Must be outside a render pass.
+    void record(const vk::CommandBuffer& cmd, uint32_t frame_index, const Frustum& frustum);
+    // Draws the survivors; the caller binds the pipeline and the geometry buffers.
+    void draw(const vk::CommandBuffer& cmd) const;
+    // Call once the frame's fence has signaled.
+    void collect(uint32_t frame_index);
+
+    CullStats stats() const { return m_stats; }
+
+private:
+    vk::Device m_device;
+    vk::Pipeline m_pipeline;
+    uint32_t m_group_size = 64;
+    BindlessDescriptors* m_bindless = nullptr;
+    uint32_t m_objects_index = 0;
+    uint32_t m_commands_index = 0;
+    uint32_t m_counters_index = 0;
+
+    AllocatedBuffer m_objects;
+    AllocatedBuffer m_commands;
+    AllocatedBuffer m_counters;
+    AllocatedBuffer m_readback;
+
+    uint32_t m_object_count = 0;
+    bool m_compact = false;
+    uint32_t m_max_draw_indirect_count = 1;
+    std::vector<bool> m_frame_recorded;
+    CullStats m_stats;
+};
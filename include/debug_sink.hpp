@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vk.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+struct DebugMessageCounts {
+    // Indexed by severity: verbose, info, warning, error.
+    std::array<uint64_t, 4> severity{};
+    // Indexed by type: general, validation, performance, device address binding.
+    std::array<uint64_t, 4> type{};
+    // Lost because the ring was full when the message arrived.
+    uint64_t dropped = 0;
+    // Held back by the per-message rate limit.
+    uint64_t suppressed = 0;
+};
+
+// Receives debug utils messages without doing I/O on the thread that raised them. The callback
+// only copies the message into a slot of a lock-free multi-producer ring; a background thread
+// drains the ring and writes to the output stream. Every messageIdNumber may print at most
+// max_per_second times per second, and repeats past that are folded into a single summary line.
+// Messages below min_printed are only counted.
+class DebugMessageSink {
+public:
+    static constexpr size_t capacity = 1024;
+    static constexpr size_t max_message_length = 1024;
+    static constexpr uint32_t default_max_per_second = 5;
+
+    explicit DebugMessageSink(std::ostream& out, uint32_t max_per_second = default_max_per_second,
+                              VkDebugUtilsMessageSeverityFlagBitsEXT min_printed = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT);
+    // Drains whatever is still queued before returning.
+    ~DebugMessageSink();
+
+    DebugMessageSink(const DebugMessageSink&) = delete;
+    DebugMessageSink& operator=(const DebugMessageSink&) = delete;
+
+    // Safe to call from any thread. Never blocks and never allocates; returns false when the
+    // message was dropped because the writer fell a full ring behind.
+    bool push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+              const VkDebugUtilsMessengerCallbackDataEXT* data);
+
+    DebugMessageCounts counts() const;
+    VkDebugUtilsMessageSeverityFlagBitsEXT min_printed() const { return m_min_printed; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        int32_t id;
+        char message[max_message_length];
+    };
+
+    struct RateLimit {
+        Clock::time_point window_start;
+        uint32_t printed = 0;
+        uint64_t suppressed = 0;
+    };
+
+    void writer();
+    bool pop(Slot& out);
+    void write(const Slot& slot, Clock::time_point now);
+    void flush_suppressed(int32_t id, RateLimit& limit);
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<uint64_t> m_head{ 0 };
+    alignas(64) uint64_t m_tail = 0;
+
+    std::array<std::atomic<uint64_t>, 4> m_severity_counts{};
+    std::array<std::atomic<uint64_t>, 4> m_type_counts{};
+    std::atomic<uint64_t> m_dropped{ 0 };
+    std::atomic<uint64_t> m_suppressed{ 0 };
+
+    // Only touched by the writer thread.
+    std::ostream& m_out;
+    uint32_t m_max_per_second;
+    VkDebugUtilsMessageSeverityFlagBitsEXT m_min_printed;
+    std::unordered_map<int32_t, RateLimit> m_limits;
+
+    std::atomic<bool> m_stop{ false };
+    std::thread m_thread;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <variant>
+#include <vector>
+
+using DeferredHandle = std::variant<vk::Pipeline, vk::PipelineLayout, vk::ShaderModule, vk::RenderPass,
+                                    vk::Framebuffer, vk::ImageView, vk::Sampler, vk::DescriptorSetLayout,
+                                    vk::SwapchainKHR, vk::Semaphore, AllocatedBuffer, AllocatedImage>;
+
+struct DeletionStats {
+    uint64_t queued = 0;
+    uint64_t released = 0;
+    uint64_t batches = 0;
+};
+
+// Holds on to objects the GPU may still be using until it has provably moved past them, so
+// they can be replaced at runtime without vkDeviceWaitIdle. An object is retired either with
+// the last frame that may have used it, released once collect() is told that frame completed,
+// or with a timeline semaphore value, released once the semaphore reaches it.
+//
+// Objects retired with the same key are released together. Keys usually arrive in order, which
+// keeps retire() and collect() constant time per object. Safe to call from any thread.
+class DeletionQueue {
+public:
+    void init(const vk::Device& device, GpuAllocator& allocator);
+    // Releases everything regardless of GPU progress, so only with the device idle.
+    void destroy();
+
+    void retire(DeferredHandle handle, uint64_t last_frame);
+    void retire(DeferredHandle handle, vk::Semaphore timeline, uint64_t value);
+
+    // Every frame up to and including completed_frame has finished on the GPU. Also polls the
+    // timelines that have something pending.
+    void collect(uint64_t completed_frame);
+    // Call with the device idle: releases everything still pending.
+    void flush();
+
+    DeletionStats stats() const;
+
+private:
+    struct Batch {
+        uint64_t key = 0;
+        std::vector<DeferredHandle> handles;
+    };
+
+    struct Timeline {
+        vk::Semaphore semaphore;
+        std::deque<Batch> batches;
+    };
+
+    static void enqueue(std::deque<Batch>& batches, DeferredHandle handle, uint64_t key);
+    static void take_ready(std::deque<Batch>& batches, uint64_t completed, std::vector<Batch>& ready);
+    void release(std::vector<Batch>& ready);
+    void release(const DeferredHandle& handle);
+
+    vk::Device m_device;
+    GpuAllocator* m_allocator = nullptr;
+    std::deque<Batch> m_frame_batches;
+    std::vector<Timeline> m_timelines;
+    DeletionStats m_stats;
+    mutable std::mutex m_mutex;
+};
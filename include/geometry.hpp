@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <upload.hpp>
+#include <toolkits.hpp>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+struct VertexAttribute {
+    uint32_t location;
+    vk::Format format;
+};
+
+// One vertex buffer binding. Attributes are tightly packed in declaration order, so the stride
+// is the sum of the attribute sizes.
+struct VertexStream {
+    vk::VertexInputRate input_rate = vk::VertexInputRate::eVertex;
+    std::vector<VertexAttribute> attributes;
+
+    uint32_t stride() const;
+};
+
+// Stream i is bound to binding i.
+struct VertexFormat {
+    std::vector<VertexStream> streams;
+
+    std::vector<vk::VertexInputBindingDescription> bindings() const;
+    std::vector<vk::VertexInputAttributeDescription> attributes() const;
+};
+
+// Size in bytes of one element of a vertex attribute format.
+uint32_t format_size(vk::Format format);
+
+// A mesh inside a GeometryBatch: a range of the shared index buffer plus the offset of its
+// first vertex in the shared vertex streams.
+struct MeshRange {
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    int32_t vertex_offset = 0;
+};
+
+// Every mesh, instance and draw of a scene packed into one buffer per vertex stream, one index
+// buffer and one indirect command buffer. Recording binds the buffers once and submits draw
+// ranges with a single vkCmdDrawIndexedIndirectCount (or vkCmdDrawIndexedIndirect), so the CPU
+// cost per frame does not depend on how many instances are drawn. Devices without
+// multiDrawIndirect or drawIndirectFirstInstance fall back to one vkCmdDrawIndexed per draw.
+class GeometryBatch {
+public:
+    void init(const DeviceCapabilities& caps, const VertexFormat& format);
+    void destroy(GpuAllocator& allocator);
+
+    // Appends count tightly packed elements to a stream and returns the index of the first one.
+    uint32_t append(uint32_t stream, const void* data, uint32_t count);
+    MeshRange add_mesh(std::span<const uint32_t> indices, uint32_t first_vertex);
+    void add_draw(const MeshRange& mesh, uint32_t first_instance, uint32_t instance_count);
+
+    // Creates device-local buffers sized to the batch and queues their contents on the upload
+    // service. Vertex and index data are released afterwards; draw commands stay on the CPU
+    // for the fallback path.
+    void upload(GpuAllocator& allocator, UploadService& uploads);
+
+    void bind(const vk::CommandBuffer& cmd) const;
+    void draw(const vk::CommandBuffer& cmd, uint32_t first_draw, uint32_t draw_count) const;
+
+    uint32_t draw_count() const { return static_cast<uint32_t>(m_commands.size()); }
+    uint32_t instance_count() const { return m_instance_count; }
+    vk::Buffer indirect_buffer() const { return m_indirect.buffer; }
+    vk::Buffer count_buffer() const { return m_count.buffer; }
+
+private:
+    VertexFormat m_format;
+    std::vector<std::vector<std::byte>> m_stream_data;
+    std::vector<uint32_t> m_indices;
+    std::vector<vk::DrawIndexedIndirectCommand> m_commands;
+    uint32_t m_instance_count = 0;
+
+    std::vector<AllocatedBuffer> m_streams;
+    std::vector<vk::Buffer> m_stream_buffers;
+    AllocatedBuffer m_index;
+    AllocatedBuffer m_indirect;
+    AllocatedBuffer m_count;
+
+    bool m_multi_draw = false;
+    bool m_draw_indirect_count = false;
+    uint32_t m_max_draw_indirect_count = 1;
+};
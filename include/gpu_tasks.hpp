@@ -0,0 +1,255 @@
+#pragma once
+
+#include <vk.hpp>
+#include <thread_pool.hpp>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A point on a timeline semaphore: the work it stands for is done once the counter reaches value.
+struct TimelinePoint {
+    vk::Semaphore semaphore;
+    uint64_t value = 0;
+};
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    // Resumed by symmetric transfer when the task finishes; nothing for a task nobody awaits.
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T result() {
+        if (error)
+            std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+// Starts eagerly and owns itself; used to run a Task to completion from non-coroutine code.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+}
+
+// A lazily started coroutine. It runs when awaited, on the awaiting thread, and resumes its
+// awaiter when it finishes. Exceptions propagate to the awaiter.
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter { m_handle };
+    }
+
+private:
+    friend promise_type;
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Runs CPU work and GPU waits as coroutines on the ThreadPool. Tasks co_await schedule() to move
+// onto a worker, and co_await a timeline value or fence to suspend until the GPU gets there
+// without occupying any thread. A single waiter thread blocks in vkWaitSemaphores (wait-any) on
+// every pending timeline at once and hands the coroutines whose values were reached back to the
+// pool, so a chain like upload -> compute -> draw -> readback pipelines without blocking:
+//
+//     Task<> stream(TaskScheduler& tasks, ...) {
+//         co_await tasks.wait(uploads.timeline(), uploads.flush());
+//         co_await tasks.wait(tasks.submit(compute_queue, compute_cmds));
+//         ...
+//     }
+//     tasks.spawn(stream(tasks, ...));
+//
+// Fences cannot join a semaphore wait, so while any are awaited the waiter also polls them every
+// fence_poll_interval. An awaited fence must not be reset before the wait completes. When waiting
+// fails outright (device loss), the waiter fails every pending wait and stops, and any later wait
+// fails with the same error right away.
+class TaskScheduler {
+public:
+    static constexpr std::chrono::microseconds fence_poll_interval{ 500 };
+
+    void init(const vk::Device& device, ThreadPool& pool);
+    // Stops the waiter. Coroutines still waiting on the GPU are abandoned, so idle the device
+    // and let spawned tasks finish first.
+    void destroy();
+
+    struct ScheduleAwaiter {
+        TaskScheduler& scheduler;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) const { scheduler.resume_on_pool(handle); }
+        void await_resume() const noexcept {}
+    };
+
+    struct GpuAwaiter {
+        TaskScheduler& scheduler;
+        TimelinePoint point;
+        vk::Fence fence;
+        std::coroutine_handle<> handle;
+        // Set by the waiter when waiting failed, e.g. on device loss.
+        std::exception_ptr error;
+
+        bool await_ready() const { return scheduler.is_complete(*this); }
+        void await_suspend(std::coroutine_handle<> awaiting) {
+            handle = awaiting;
+            scheduler.enqueue(this);
+        }
+        void await_resume() const {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+
+    // Continues the awaiting coroutine on a pool worker.
+    ScheduleAwaiter schedule() { return ScheduleAwaiter { *this }; }
+    GpuAwaiter wait(TimelinePoint point) { return GpuAwaiter { .scheduler = *this, .point = point }; }
+    GpuAwaiter wait(vk::Semaphore timeline, uint64_t value) { return wait(TimelinePoint { timeline, value }); }
+    GpuAwaiter wait(vk::Fence fence) { return GpuAwaiter { .scheduler = *this, .fence = fence }; }
+
+    // Submits cmds once every point in waits is reached and returns the point on the scheduler's
+    // own timeline that signals their completion. Submissions from tasks are serialized here, but
+    // the queue must not be submitted to from outside the scheduler at the same time.
+    TimelinePoint submit(const vk::Queue& queue, std::span<const vk::CommandBuffer> cmds,
+                         std::span<const TimelinePoint> waits = {},
+                         vk::PipelineStageFlags wait_stages = vk::PipelineStageFlagBits::eAllCommands);
+
+    // Starts task on a pool worker. The future reports its result or exception.
+    template <typename T>
+    std::future<T> spawn(Task<T> task);
+
+    vk::Semaphore timeline() const { return m_timeline; }
+
+private:
+    template <typename T>
+    static detail::DetachedTask run_detached(TaskScheduler& scheduler, Task<T> task, std::promise<T> promise);
+
+    void resume_on_pool(std::coroutine_handle<> handle);
+    bool is_complete(const GpuAwaiter& awaiter) const;
+    void enqueue(GpuAwaiter* awaiter);
+    void wake_locked();
+    void waiter();
+
+    vk::Device m_device;
+    ThreadPool* m_pool = nullptr;
+    std::thread m_waiter;
+
+    // Host-signalled so that a new wait or destroy() can interrupt vkWaitSemaphores.
+    vk::Semaphore m_wake;
+    uint64_t m_wake_value = 0;
+    std::vector<GpuAwaiter*> m_pending;
+    bool m_stop = false;
+    // Why the waiter stopped on its own.
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+
+    vk::Semaphore m_timeline;
+    uint64_t m_submitted = 0;
+    std::mutex m_submit_mutex;
+};
+
+template <typename T>
+std::future<T> TaskScheduler::spawn(Task<T> task) {
+    std::promise<T> promise;
+    std::future<T> future = promise.get_future();
+    run_detached(*this, std::move(task), std::move(promise));
+    return future;
+}
+
+template <typename T>
+detail::DetachedTask TaskScheduler::run_detached(TaskScheduler& scheduler, Task<T> task, std::promise<T> promise) {
+    co_await scheduler.schedule();
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            promise.set_value();
+        } else {
+            promise.set_value(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <profiler.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+struct LatencyStats {
+    std::string mode;
+    FrameTimeStats latency;
+};
+
+// Input-to-present latency, bucketed by the present mode the frame went out with. A frame's
+// latency runs from the moment its input was sampled to the moment its present is observed
+// complete. The application polls for completion once per frame, so samples are quantized to
+// the frame interval.
+class LatencyTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void frame_started(uint64_t id, const std::string& mode, Clock::time_point input_time);
+    // Records id and discards older pending frames: under MAILBOX they were replaced, not shown.
+    void frame_completed(uint64_t id, Clock::time_point time);
+    // Forgets frames presented to a swapchain that has been replaced.
+    void drop_pending() { m_pending.clear(); }
+
+    bool has_pending() const { return !m_pending.empty(); }
+    uint64_t oldest_pending() const { return m_pending.front().id; }
+
+    std::vector<LatencyStats> stats() const;
+
+private:
+    struct Pending {
+        uint64_t id;
+        std::string mode;
+        Clock::time_point input_time;
+    };
+
+    std::deque<Pending> m_pending;
+    std::map<std::string, std::deque<double>> m_samples;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct HeapBudget {
+    vk::DeviceSize size = 0;
+    // What the process uses and may use of this heap, as of the last update().
+    vk::DeviceSize usage = 0;
+    vk::DeviceSize budget = 0;
+    vk::DeviceSize peak_usage = 0;
+    bool device_local = false;
+};
+
+struct EvictionRequest {
+    uint32_t heap = 0;
+    vk::DeviceSize usage = 0;
+    vk::DeviceSize budget = 0;
+    // Still to be released to get back down to MemoryBudget::evict_target.
+    vk::DeviceSize bytes = 0;
+    // Raised by an allocation about to happen rather than at a frame boundary. Releasing memory
+    // the allocation would have reused (e.g. empty allocator blocks) only makes it allocate anew.
+    bool allocating = false;
+};
+
+// Releases or downgrades something on request.heap (drops mip levels, flushes a cache) and
+// returns roughly how many bytes that gave back, 0 when it had nothing left to give.
+using EvictionHandler = std::function<vk::DeviceSize(const EvictionRequest& request)>;
+
+struct EvictionHandlerStats {
+    std::string name;
+    vk::DeviceSize released_bytes = 0;
+};
+
+struct MemoryBudgetStats {
+    uint64_t samples = 0;
+    // Eviction passes, and how many of them an allocation raised.
+    uint64_t evictions = 0;
+    uint64_t allocation_evictions = 0;
+    vk::DeviceSize evicted_bytes = 0;
+    std::vector<EvictionHandlerStats> handlers;
+    // No VK_EXT_memory_budget: usage is what GpuAllocator holds and the budget a share of the heap.
+    bool estimated = false;
+};
+
+// Per-heap usage and budget, sampled from VK_EXT_memory_budget once per frame. Between samples
+// the allocator's growth is added on top, so the allocation that would cross the budget is
+// caught before the driver has to fail it.
+//
+// Once a heap passes evict_threshold of its budget, the eviction handlers run in registration
+// order, cheapest first, until the heap is back at evict_target. A heap that stays over the
+// threshold is only evicted again when its usage grows further. Passes are silent; they show up
+// in stats().
+class MemoryBudget {
+public:
+    static constexpr double evict_threshold = 0.9;
+    static constexpr double evict_target = 0.8;
+    // Drivers commonly report about this share of a heap as the budget of a single process.
+    static constexpr double estimated_budget_share = 0.8;
+
+    // Installs itself as the allocator's budget check. A nonzero budget_limit caps the budget of
+    // every device-local heap, which makes eviction testable on devices with plenty of memory.
+    void init(const vk::PhysicalDevice& phy_device, GpuAllocator& allocator, bool memory_budget_ext,
+              vk::DeviceSize budget_limit = 0);
+    void destroy();
+
+    // Render thread, once per frame.
+    void update();
+    // Handlers are called from update() and from any thread that allocates, the latter with
+    // request.allocating set. Add them before rendering starts; they may free memory but must
+    // not allocate.
+    void add_eviction_handler(std::string name, EvictionHandler handler);
+
+    std::vector<HeapBudget> heaps() const;
+    MemoryBudgetStats stats() const;
+
+private:
+    struct Heap {
+        HeapBudget budget;
+        // Allocator bytes at the last sample, to project usage until the next one.
+        vk::DeviceSize reserved_at_sample = 0;
+        // Usage the last frame-boundary and allocation pass ran at; 0 once back under the threshold.
+        vk::DeviceSize evicted_at = 0;
+        vk::DeviceSize allocation_evicted_at = 0;
+    };
+
+    struct NamedHandler {
+        std::string name;
+        EvictionHandler handler;
+        vk::DeviceSize released_bytes = 0;
+    };
+
+    void check(uint32_t heap, vk::DeviceSize size);
+    void evict_if_needed(uint32_t heap, vk::DeviceSize usage, bool allocating);
+
+    vk::PhysicalDevice m_phy_device;
+    GpuAllocator* m_allocator = nullptr;
+    bool m_memory_budget_ext = false;
+    vk::DeviceSize m_budget_limit = 0;
+    std::vector<Heap> m_heaps;
+    MemoryBudgetStats m_stats;
+    mutable std::mutex m_mutex;
+
+    // Held while handlers run; a thread that finds it taken lets the running pass do the work.
+    mutable std::mutex m_evict_mutex;
+    std::vector<NamedHandler> m_handlers;
+};
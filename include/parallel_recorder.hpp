@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vk.hpp>
+#include <work_stealing.hpp>
+#include <functional>
+#include <vector>
+
+// Splits a draw list into slices and records each slice into a secondary command buffer on the
+// scheduler's workers. Every (frame in flight, worker) pair owns its own command pool, so workers
+// never contend on a pool and a frame's buffers are recycled by resetting its pools.
+class ParallelRecorder {
+public:
+    using RecordSlice = std::function<void(const vk::CommandBuffer& cmd, uint32_t first_draw, uint32_t draw_count)>;
+
+    void init(const vk::Device& device, uint32_t queue_family, uint32_t frames_in_flight, WorkStealingScheduler& scheduler);
+    void destroy();
+
+    // The frame's fence must have been waited on. The returned buffers are in draw order and
+    // stay valid until the same frame index is recorded again.
+    const std::vector<vk::CommandBuffer>& record(uint32_t frame_index, const vk::CommandBufferInheritanceInfo& inheritance,
+                                                 uint32_t draw_count, const RecordSlice& record_slice);
+
+private:
+    struct WorkerPool {
+        vk::CommandPool pool;
+        std::vector<vk::CommandBuffer> buffers;
+        uint32_t used = 0;
+    };
+
+    vk::CommandBuffer next_buffer(WorkerPool& pool);
+
+    vk::Device m_device;
+    WorkStealingScheduler* m_scheduler = nullptr;
+    std::vector<std::vector<WorkerPool>> m_pools;
+    std::vector<vk::CommandBuffer> m_slices;
+};
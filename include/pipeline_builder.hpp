@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vk.hpp>
+#include <thread_pool.hpp>
+#include <geometry.hpp>
+#include <pipeline_state.hpp>
+#include <chrono>
+#include <span>
+#include <string>
+#include <vector>
+
+// One graphics pipeline to build from a pair of shaders: its fixed-function state, its target
+// and the specialization constants of each stage.
+struct PipelineVariant {
+    PipelineState state;
+    // Null uses the builder's render pass; set it for variants targeting another color format.
+    vk::RenderPass render_pass = nullptr;
+    // Without any render pass the pipeline targets dynamic rendering into this color format.
+    vk::Format color_format = vk::Format::eUndefined;
+    SpecializationConstants vertex_constants;
+    SpecializationConstants fragment_constants;
+
+    std::string describe() const;
+    // Equal keys compile to the same pipeline. shaders_hash identifies the shader modules;
+    // The target is the build's render pass and color format, unless the variant sets its own.
+    uint64_t key(uint64_t shaders_hash, vk::RenderPass target_render_pass, vk::Format target_format) const;
+    // Topology x cull mode x front face x blend, starting with the default variant. Combinations
+    // that normalize to the same state (line culling, for one) are dropped at compile time.
+    static std::vector<PipelineVariant> permutations();
+    // The dynamic-state pipelines covering everything permutations() bakes: one per topology
+    // class and blend mode, all rendering dynamically into color_format.
+    static std::vector<PipelineVariant> dynamic_permutations(vk::Format color_format);
+};
+
+// Values for the state a dynamic_state pipeline leaves open, matching the default variant.
+void set_default_dynamic_state(const vk::CommandBuffer& cmd);
+
+// Must match the constant_id declarations in shader.frag.
+inline constexpr uint32_t fragment_alpha_constant = 0;
+
+struct PipelineShaders {
+    vk::ShaderModule vertex;
+    vk::ShaderModule fragment;
+    // The vertex shader's input interface.
+    VertexFormat vertex_format;
+    // Identifies the SPIR-V of both stages in pipeline keys, see shader_hash().
+    uint64_t hash = 0;
+};
+
+struct PipelineBuildResult {
+    vk::Pipeline pipeline;
+    uint64_t key = 0;
+    std::chrono::nanoseconds compile_time;
+};
+
+vk::Pipeline create_graphics_pipeline(const vk::Device& device, const vk::PipelineCache& cache, 
+                                      const PipelineShaders& shaders, const vk::PipelineLayout& layout,
+                                      const vk::RenderPass& render_pass, const PipelineVariant& variant);
+
+// Compiles a batch of variants concurrently. The pipeline cache is internally synchronized,
+// so every worker feeds the same one.
+class PipelineBuilder {
+public:
+    PipelineBuilder(const vk::Device& device, const vk::PipelineCache& cache, ThreadPool& pool);
+
+    // One result per distinct key, in the order the keys first appear in variants; variants
+    // repeating a key are not compiled again. color_format is what render_pass renders into.
+    std::vector<PipelineBuildResult> build(const PipelineShaders& shaders, const vk::PipelineLayout& layout,
+                                           const vk::RenderPass& render_pass, vk::Format color_format,
+                                           std::span<const PipelineVariant> variants);
+
+    std::chrono::nanoseconds wall_time() const { return m_wall_time; }
+    uint32_t duplicates() const { return m_duplicates; }
+
+private:
+    vk::Device m_device;
+    vk::PipelineCache m_cache;
+    ThreadPool& m_pool;
+    std::chrono::nanoseconds m_wall_time{ 0 };
+    uint32_t m_duplicates = 0;
+};
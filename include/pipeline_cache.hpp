@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vk.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Persistent VkPipelineCache. The driver blob is wrapped in a small header carrying a checksum
+// and the compile time of the cold start that produced it, so warm starts can report the saving.
+// Files written for another device or driver, truncated or corrupt files are ignored.
+class PipelineCache {
+public:
+    // Reads the file off disk. Needs no device, so it can run while the device is being created.
+    void load(const std::string& path);
+    void create(const vk::Device& device, const vk::PhysicalDeviceProperties& properties);
+    void save();
+    void destroy();
+
+    vk::PipelineCache handle() const { return m_cache; }
+    bool warm() const { return m_warm; }
+
+    void add_compile_time(std::chrono::nanoseconds elapsed);
+    void report() const;
+
+private:
+    bool validate(const std::vector<char>& file, std::vector<char>& blob);
+
+    vk::Device m_device;
+    vk::PhysicalDeviceProperties m_properties;
+    vk::PipelineCache m_cache;
+    std::string m_path;
+    std::vector<char> m_file;
+    bool m_warm = false;
+    std::chrono::nanoseconds m_compile_time{ 0 };
+    std::chrono::nanoseconds m_cold_compile_time{ 0 };
+};
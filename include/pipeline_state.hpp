@@ -0,0 +1,311 @@
+#pragma once
+
+#include <vk.hpp>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+// 64-bit FNV-1a over whole words, usable in constant expressions.
+class PipelineHash {
+public:
+    constexpr PipelineHash& add(uint64_t word) {
+        for (int i = 0; i < 8; ++i) {
+            m_value ^= (word >> (i * 8)) & 0xff;
+            m_value *= 0x100000001b3ull;
+        }
+        return *this;
+    }
+    template <typename Enum>
+    constexpr PipelineHash& add_enum(Enum value) { return add(static_cast<uint64_t>(value)); }
+
+    constexpr uint64_t value() const { return m_value; }
+
+private:
+    uint64_t m_value = 0xcbf29ce484222325ull;
+};
+
+enum class BlendMode : uint32_t {
+    Opaque,
+    // Straight alpha: src * a + dst * (1 - a).
+    Alpha,
+    Additive
+};
+
+// The fixed-function state of a graphics pipeline. Only enums and bools, so a PipelineState can
+// be a template argument (see StaticPipelineState) and everything derived from it, create-info
+// structs included, can be computed and checked at compile time.
+struct PipelineState {
+    vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+    bool primitive_restart = false;
+    vk::PolygonMode polygon_mode = vk::PolygonMode::eFill;
+    vk::CullModeFlagBits cull_mode = vk::CullModeFlagBits::eBack;
+    vk::FrontFace front_face = vk::FrontFace::eClockwise;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+    BlendMode blend = BlendMode::Opaque;
+    bool depth_test = false;
+    bool depth_write = false;
+    vk::CompareOp depth_compare = vk::CompareOp::eLessOrEqual;
+    // Topology (within its list, strip or line class), cull mode, front face and the depth state
+    // are set while recording instead of being baked in; the fields above only pick the class.
+    bool dynamic_state = false;
+
+    constexpr bool operator==(const PipelineState&) const = default;
+
+    // Null when valid, otherwise what is wrong.
+    constexpr const char* error() const {
+        if (topology == vk::PrimitiveTopology::ePatchList)
+            return "Patch lists need tessellation shaders";
+        if (primitive_restart && is_list())
+            return "Primitive restart needs a strip or fan topology";
+        return nullptr;
+    }
+
+    // Clears everything the pipeline ignores, so states that compile to the same pipeline compare
+    // and hash equal: culling and winding for points and lines, depth state without a depth test,
+    // and whatever dynamic_state leaves to the command buffer.
+    constexpr PipelineState normalized() const {
+        PipelineState state = *this;
+        if (!state.depth_test) {
+            state.depth_write = false;
+            state.depth_compare = PipelineState{}.depth_compare;
+        }
+        if (!state.is_triangles()) {
+            state.cull_mode = vk::CullModeFlagBits::eNone;
+            state.front_face = PipelineState{}.front_face;
+        }
+        if (state.dynamic_state) {
+            state.topology = state.topology_class();
+            state.cull_mode = PipelineState{}.cull_mode;
+            state.front_face = PipelineState{}.front_face;
+            state.depth_test = false;
+            state.depth_write = false;
+            state.depth_compare = PipelineState{}.depth_compare;
+        }
+        return state;
+    }
+
+    constexpr uint64_t hash() const {
+        PipelineState state = normalized();
+        return PipelineHash{}
+            .add_enum(state.topology)
+            .add(state.primitive_restart)
+            .add_enum(state.polygon_mode)
+            .add_enum(state.cull_mode)
+            .add_enum(state.front_face)
+            .add_enum(state.samples)
+            .add_enum(state.blend)
+            .add(state.depth_test)
+            .add(state.depth_write)
+            .add_enum(state.depth_compare)
+            .add(state.dynamic_state)
+            .value();
+    }
+
+    constexpr bool is_list() const {
+        return topology == vk::PrimitiveTopology::ePointList || topology == vk::PrimitiveTopology::eLineList
+            || topology == vk::PrimitiveTopology::eTriangleList || topology == vk::PrimitiveTopology::eLineListWithAdjacency
+            || topology == vk::PrimitiveTopology::eTriangleListWithAdjacency;
+    }
+    constexpr bool is_triangles() const {
+        return topology == vk::PrimitiveTopology::eTriangleList || topology == vk::PrimitiveTopology::eTriangleStrip
+            || topology == vk::PrimitiveTopology::eTriangleFan || topology == vk::PrimitiveTopology::eTriangleListWithAdjacency
+            || topology == vk::PrimitiveTopology::eTriangleStripWithAdjacency;
+    }
+    // What vkCmdSetPrimitiveTopology may switch between without dynamicPrimitiveTopologyUnrestricted.
+    constexpr vk::PrimitiveTopology topology_class() const {
+        if (topology == vk::PrimitiveTopology::ePointList)
+            return vk::PrimitiveTopology::ePointList;
+        return is_triangles() ? vk::PrimitiveTopology::eTriangleList : vk::PrimitiveTopology::eLineList;
+    }
+};
+
+constexpr vk::PipelineInputAssemblyStateCreateInfo input_assembly_state(const PipelineState& state) {
+    return vk::PipelineInputAssemblyStateCreateInfo {
+        .topology = state.topology,
+        .primitiveRestartEnable = static_cast<vk::Bool32>(state.primitive_restart)
+    };
+}
+
+constexpr vk::PipelineRasterizationStateCreateInfo rasterization_state(const PipelineState& state) {
+    return vk::PipelineRasterizationStateCreateInfo {
+        .depthClampEnable = static_cast<vk::Bool32>(false),
+        .rasterizerDiscardEnable = static_cast<vk::Bool32>(false),
+        .polygonMode = state.polygon_mode,
+        .cullMode = state.cull_mode,
+        .frontFace = state.front_face,
+        .depthBiasEnable = static_cast<vk::Bool32>(false),
+        .lineWidth = 1.0f
+    };
+}
+
+constexpr vk::PipelineMultisampleStateCreateInfo multisample_state(const PipelineState& state) {
+    return vk::PipelineMultisampleStateCreateInfo {
+        .rasterizationSamples = state.samples,
+        .sampleShadingEnable = static_cast<vk::Bool32>(false)
+    };
+}
+
+constexpr vk::PipelineDepthStencilStateCreateInfo depth_stencil_state(const PipelineState& state) {
+    return vk::PipelineDepthStencilStateCreateInfo {
+        .depthTestEnable = static_cast<vk::Bool32>(state.depth_test),
+        .depthWriteEnable = static_cast<vk::Bool32>(state.depth_write),
+        .depthCompareOp = state.depth_compare
+    };
+}
+
+constexpr vk::PipelineColorBlendAttachmentState color_blend_attachment_state(const PipelineState& state) {
+    return vk::PipelineColorBlendAttachmentState {
+        .blendEnable = static_cast<vk::Bool32>(state.blend != BlendMode::Opaque),
+        .srcColorBlendFactor = vk::BlendFactor::eSrcAlpha,
+        .dstColorBlendFactor = state.blend == BlendMode::Additive ? vk::BlendFactor::eOne : vk::BlendFactor::eOneMinusSrcAlpha,
+        .colorBlendOp = vk::BlendOp::eAdd,
+        .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+        .dstAlphaBlendFactor = vk::BlendFactor::eZero,
+        .alphaBlendOp = vk::BlendOp::eAdd,
+        .colorWriteMask = vk::ColorComponentFlagBits::eR
+                        | vk::ColorComponentFlagBits::eG
+                        | vk::ColorComponentFlagBits::eB
+                        | vk::ColorComponentFlagBits::eA
+    };
+}
+
+// Viewport and scissor are always dynamic.
+struct DynamicStateList {
+    std::array<vk::DynamicState, 8> states{};
+    uint32_t count = 0;
+};
+
+constexpr DynamicStateList dynamic_state_list(const PipelineState& state) {
+    DynamicStateList list;
+    list.states[list.count++] = vk::DynamicState::eViewport;
+    list.states[list.count++] = vk::DynamicState::eScissor;
+    if (state.dynamic_state) {
+        for (auto dynamic : { vk::DynamicState::ePrimitiveTopology, vk::DynamicState::eCullMode,
+                              vk::DynamicState::eFrontFace, vk::DynamicState::eDepthTestEnable,
+                              vk::DynamicState::eDepthWriteEnable, vk::DynamicState::eDepthCompareOp })
+            list.states[list.count++] = dynamic;
+    }
+    return list;
+}
+
+// Every fixed-function create-info struct of State, validated and built by the compiler. The
+// structs that point at others point at members of this class, so they can be handed to
+// vk::GraphicsPipelineCreateInfo as they are.
+template <PipelineState State>
+struct StaticPipelineState {
+    static_assert(State.error() == nullptr, "Invalid PipelineState, see PipelineState::error()");
+
+    static constexpr PipelineState state = State.normalized();
+    static constexpr uint64_t hash = State.hash();
+
+    static constexpr vk::PipelineInputAssemblyStateCreateInfo input_assembly = input_assembly_state(state);
+    static constexpr vk::PipelineRasterizationStateCreateInfo rasterization = rasterization_state(state);
+    static constexpr vk::PipelineMultisampleStateCreateInfo multisample = multisample_state(state);
+    static constexpr vk::PipelineDepthStencilStateCreateInfo depth_stencil = depth_stencil_state(state);
+    static constexpr vk::PipelineColorBlendAttachmentState color_blend_attachment = color_blend_attachment_state(state);
+    static constexpr vk::PipelineColorBlendStateCreateInfo color_blend {
+        .logicOpEnable = static_cast<vk::Bool32>(false),
+        .logicOp = vk::LogicOp::eCopy,
+        .attachmentCount = 1,
+        .pAttachments = &color_blend_attachment
+    };
+    static constexpr DynamicStateList dynamic_states = dynamic_state_list(state);
+    static constexpr vk::PipelineDynamicStateCreateInfo dynamic {
+        .dynamicStateCount = dynamic_states.count,
+        .pDynamicStates = dynamic_states.states.data()
+    };
+};
+
+// Up to max_constants 32-bit SPIR-V specialization constants for one shader stage, so a single
+// shader module compiles into tuned variants (group sizes, toggles) with the choice folded away.
+class SpecializationConstants {
+public:
+    static constexpr uint32_t max_constants = 8;
+
+    // Kept sorted by id, so the same constants hash alike whatever order they were set in.
+    constexpr SpecializationConstants& set(uint32_t constant_id, uint32_t value) {
+        uint32_t i = 0;
+        while (i < m_count && m_ids[i] < constant_id)
+            ++i;
+        if (i == m_count || m_ids[i] != constant_id) {
+            if (m_count == max_constants)
+                throw std::length_error("Too many specialization constants");
+            for (uint32_t j = m_count; j > i; --j) {
+                m_ids[j] = m_ids[j - 1];
+                m_values[j] = m_values[j - 1];
+            }
+            m_ids[i] = constant_id;
+            ++m_count;
+        }
+        m_values[i] = value;
+        return *this;
+    }
+    // SPIR-V booleans are 32 bits wide.
+    constexpr SpecializationConstants& set(uint32_t constant_id, bool value) { return set(constant_id, uint32_t{ value }); }
+    constexpr SpecializationConstants& set(uint32_t constant_id, int32_t value) { return set(constant_id, std::bit_cast<uint32_t>(value)); }
+    constexpr SpecializationConstants& set(uint32_t constant_id, float value) { return set(constant_id, std::bit_cast<uint32_t>(value)); }
+
+    bool empty() const { return m_count == 0; }
+
+    constexpr uint64_t hash() const {
+        PipelineHash hash;
+        for (uint32_t i = 0; i < m_count; ++i)
+            hash.add(uint64_t{ m_ids[i] } << 32 | m_values[i]);
+        return hash.value();
+    }
+
+    // Points into entries and this object, both of which have to outlive pipeline creation.
+    vk::SpecializationInfo info(std::array<vk::SpecializationMapEntry, max_constants>& entries) const {
+        for (uint32_t i = 0; i < m_count; ++i) {
+            entries[i] = vk::SpecializationMapEntry {
+                .constantID = m_ids[i],
+                .offset = static_cast<uint32_t>(i * sizeof(uint32_t)),
+                .size = sizeof(uint32_t)
+            };
+        }
+        return vk::SpecializationInfo {
+            .mapEntryCount = m_count,
+            .pMapEntries = entries.data(),
+            .dataSize = m_count * sizeof(uint32_t),
+            .pData = m_values.data()
+        };
+    }
+
+private:
+    std::array<uint32_t, max_constants> m_ids{};
+    std::array<uint32_t, max_constants> m_values{};
+    uint32_t m_count = 0;
+};
+
+// Identifies SPIR-V for pipeline keys; computed once per shader, not per pipeline.
+inline uint64_t shader_hash(std::span<const uint32_t> code) {
+    PipelineHash hash;
+    for (uint32_t word : code)
+        hash.add(word);
+    return hash.value();
+}
+
+// The distinct normalized states among states, in first-occurrence order. Evaluated at compile
+// time for the baked permutation tables, so duplicates never reach the driver.
+template <size_t N>
+struct UniquePipelineStates {
+    std::array<PipelineState, N> states{};
+    size_t count = 0;
+};
+
+template <size_t N>
+constexpr UniquePipelineStates<N> unique_pipeline_states(const std::array<PipelineState, N>& states) {
+    UniquePipelineStates<N> unique;
+    for (const auto& state : states) {
+        PipelineState normalized = state.normalized();
+        bool seen = false;
+        for (size_t i = 0; i < unique.count && !seen; ++i)
+            seen = unique.states[i] == normalized;
+        if (!seen)
+            unique.states[unique.count++] = normalized;
+    }
+    return unique;
+}
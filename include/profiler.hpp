@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vk.hpp>
+#include <toolkits.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FrameTimeStats {
+    double mean_ms = 0.0;
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+    size_t samples = 0;
+};
+
+// Mean, median, p99 and max of a set of millisecond samples.
+FrameTimeStats summarize_frame_times(std::vector<double> samples);
+
+struct PipelineStatistics {
+    uint64_t input_vertices = 0;
+    uint64_t input_primitives = 0;
+    uint64_t vertex_invocations = 0;
+    uint64_t clipping_primitives = 0;
+    uint64_t fragment_invocations = 0;
+};
+
+class Profiler;
+
+// Records a CPU event spanning its own lifetime.
+class CpuScope {
+public:
+    CpuScope(Profiler& profiler, const char* name);
+    ~CpuScope();
+
+    CpuScope(const CpuScope&) = delete;
+    CpuScope& operator=(const CpuScope&) = delete;
+
+private:
+    Profiler& m_profiler;
+    const char* m_name;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Brackets the commands recorded during its lifetime with a pair of GPU timestamps.
+class GpuScope {
+public:
+    GpuScope(Profiler& profiler, const vk::CommandBuffer& cmd, const char* name);
+    ~GpuScope();
+
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+    Profiler& m_profiler;
+    vk::CommandBuffer m_cmd;
+    int32_t m_zone;
+};
+
+// CPU scoped timers and per-frame GPU timestamp/pipeline-statistics queries on one timeline.
+// GPU ticks are mapped onto the CPU clock through a calibration submit made at init, so both
+// show up side by side in the exported Chrome trace (chrome://tracing, Perfetto).
+// Scope names must be string literals or otherwise outlive the profiler.
+class Profiler {
+public:
+    Profiler();
+
+    void init_gpu(const vk::Device& device, const DeviceCapabilities& caps, const vk::Queue& queue,
+                  uint32_t queue_family, uint32_t frames_in_flight, bool pipeline_statistics);
+    void destroy();
+
+    CpuScope cpu_scope(const char* name) { return CpuScope(*this, name); }
+    GpuScope gpu_scope(const vk::CommandBuffer& cmd, const char* name) { return GpuScope(*this, cmd, name); }
+
+    // Bracket a frame's primary command buffer; begin_frame must come before any render pass.
+    void begin_frame(const vk::CommandBuffer& cmd, uint32_t frame_index);
+    void end_frame(const vk::CommandBuffer& cmd);
+    // Call once the frame's fence has signaled; returns the GPU time of the whole frame in ms.
+    double collect(uint32_t frame_index);
+
+    void add_frame_time(double ms);
+    FrameTimeStats frame_time_stats() const;
+    PipelineStatistics pipeline_statistics() const { return m_last_statistics; }
+
+    bool write_chrome_trace(const std::string& path) const;
+
+private:
+    friend class CpuScope;
+    friend class GpuScope;
+
+    struct Event {
+        const char* name;
+        int64_t start_ns;
+        int64_t duration_ns;
+        uint32_t thread;
+        bool gpu;
+    };
+
+    struct GpuZone {
+        const char* name;
+        uint32_t begin_query;
+        uint32_t end_query;
+    };
+
+    struct FrameQueries {
+        std::vector<GpuZone> zones;
+        uint32_t used = 0;
+        bool submitted = false;
+    };
+
+    int64_t now_ns() const;
+    uint32_t thread_index();
+    void record_event(const Event& event);
+    int32_t begin_zone(const vk::CommandBuffer& cmd, const char* name);
+    void end_zone(const vk::CommandBuffer& cmd, int32_t zone);
+    void calibrate(const vk::Queue& queue, uint32_t queue_family);
+
+    std::chrono::steady_clock::time_point m_epoch;
+
+    vk::Device m_device;
+    vk::QueryPool m_timestamp_pool;
+    vk::QueryPool m_statistics_pool;
+    std::vector<FrameQueries> m_frames;
+    uint32_t m_current_frame = 0;
+    int32_t m_frame_zone = -1;
+    double m_timestamp_period = 1.0;
+    uint64_t m_timestamp_mask = ~0ull;
+    int64_t m_gpu_offset_ns = 0;
+    PipelineStatistics m_last_statistics;
+
+    mutable std::mutex m_mutex;
+    std::vector<Event> m_events;
+    std::vector<std::thread::id> m_threads;
+    std::deque<double> m_frame_times;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <gpu_tasks.hpp>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <span>
+#include <string>
+#include <vector>
+
+struct ReadbackFrame {
+    uint64_t frame_number;
+    vk::Extent2D extent;
+    vk::Format format;
+    // Tightly packed rows of 4-byte texels, read in place from the mapped readback buffer.
+    // Only valid for the duration of the consumer call.
+    std::span<const std::byte> pixels;
+};
+
+using ReadbackConsumer = std::function<void(const ReadbackFrame&)>;
+
+// Copies rendered images into a ring of persistently mapped, preferably host-cached buffers and
+// hands them to a consumer on a worker thread once the GPU is done with them. Each delivery is a
+// TaskScheduler coroutine that awaits the frame's timeline point, so no thread blocks on the GPU
+// and a frame is delivered as soon as it completes rather than at a later frame boundary. The ring has
+// frames_in_flight + latency slots, so the consumer has latency frames to finish with a frame
+// before its slot is recorded into again; only then does the render thread wait for it.
+class FrameReadback {
+public:
+    void init(const vk::Device& device, const vk::PhysicalDeviceLimits& limits, GpuAllocator& allocator,
+              TaskScheduler& tasks, uint32_t frames_in_flight, uint32_t latency, ReadbackConsumer consumer);
+    // Waits for the consumer, so flush() first to deliver what is still pending.
+    void destroy();
+
+    // 8-bit RGBA and BGRA, UNORM or SRGB.
+    static bool supports(vk::Format format);
+
+    bool enabled() const { return static_cast<bool>(m_consumer); }
+
+    // Copies image, currently in layout, into the frame's slot and leaves it in layout again.
+    // Must be outside a render pass. Writes to image must already be made available to the
+    // transfer stage (a render pass's external dependency, or the caller's barrier); the layout
+    // change, when needed, chains onto that.
+    void record(const vk::CommandBuffer& cmd, vk::Image image, vk::ImageLayout layout,
+                vk::Extent2D extent, vk::Format format, uint64_t frame_number);
+    // The frame recorded as frame_number was submitted; completion is reached once it finishes
+    // on the GPU, and the frame goes to the consumer then.
+    void submitted(uint64_t frame_number, TimelinePoint completion);
+    // Waits until every submitted frame has been consumed; rethrows what the consumer threw.
+    void flush();
+
+    uint64_t delivered() const { return m_delivered.load(); }
+
+private:
+    struct Slot {
+        AllocatedBuffer buffer;
+        vk::DeviceSize size = 0;
+        // Recorded, but not submitted yet.
+        bool pending = false;
+        uint64_t frame_number = 0;
+        vk::Extent2D extent;
+        vk::Format format = vk::Format::eUndefined;
+        std::future<void> consumed;
+    };
+
+    Task<> deliver(Slot& slot, TimelinePoint completion);
+
+    vk::Device m_device;
+    GpuAllocator* m_allocator = nullptr;
+    TaskScheduler* m_tasks = nullptr;
+    ReadbackConsumer m_consumer;
+    std::vector<Slot> m_slots;
+    vk::MemoryPropertyFlags m_memory_properties;
+    bool m_coherent = true;
+    vk::DeviceSize m_atom_size = 1;
+    std::atomic<uint64_t> m_delivered{ 0 };
+};
+
+enum class ReadbackFileFormat {
+    Raw,
+    Ppm,
+    Png
+};
+
+// Writes each frame to <prefix>_<frame number>.<raw|ppm|png>. Raw files are the mapped bytes
+// as-is; PPM and PNG are 8-bit RGB, swizzled one row at a time from the mapped buffer. PNGs are
+// stored uncompressed to keep the writer dependency-free and cheap.
+class FrameFileWriter {
+public:
+    FrameFileWriter(std::string prefix, ReadbackFileFormat format) : m_prefix(std::move(prefix)), m_format(format) {}
+
+    // Safe to call concurrently for different frames.
+    void operator()(const ReadbackFrame& frame) const;
+
+private:
+    std::string m_prefix;
+    ReadbackFileFormat m_format;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// How a pass touches a resource. Each one maps to the synchronization2 stages, access mask and
+// (for images) layout the graph waits on and transitions to.
+enum class ResourceAccess : uint32_t {
+    ColorAttachmentWrite,
+    DepthAttachmentWrite,
+    DepthAttachmentRead,
+    FragmentSampledRead,
+    ComputeSampledRead,
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    IndirectRead,
+    TransferRead,
+    TransferWrite,
+    // Only meaningful as the final access of an imported image.
+    Present
+};
+
+struct TransientImageDesc {
+    vk::Format format;
+    vk::Extent2D extent;
+    vk::ImageUsageFlags usage;
+    vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+};
+
+struct RenderGraphStats {
+    uint32_t passes = 0;
+    uint32_t culled_passes = 0;
+    // Per execution, including the final transitions of imported images.
+    uint32_t barriers = 0;
+    // Memory backing all transient images, and what it would take without aliasing.
+    vk::DeviceSize transient_bytes = 0;
+    vk::DeviceSize unaliased_bytes = 0;
+};
+
+// A frame described as passes that declare what they read and write. compile() works out
+// everything that is otherwise written by hand:
+//   - passes whose results nobody consumes are dropped,
+//   - each pass gets one vkCmdPipelineBarrier2 with exactly the layout transitions and
+//     dependencies its accesses need (reads after reads in the same layout need none),
+//   - transient images whose lifetimes do not overlap share memory.
+//
+// Passes run in declaration order. The graph is compiled once and executed every frame; only
+// the handles of imported resources change between executions, so resource state at the start
+// of an execution is taken to be the state the previous execution left behind.
+class RenderGraph {
+public:
+    using ResourceId = uint32_t;
+    using Execute = std::function<void(const vk::CommandBuffer&)>;
+
+    class PassBuilder {
+    public:
+        PassBuilder& read(ResourceId resource, ResourceAccess access);
+        PassBuilder& write(ResourceId resource, ResourceAccess access);
+        // Keeps the pass even though nothing in the graph reads what it produces, e.g. because
+        // it synchronizes and reads back its own buffers.
+        PassBuilder& side_effect();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t pass) : m_graph(graph), m_pass(pass) {}
+
+        RenderGraph& m_graph;
+        uint32_t m_pass;
+    };
+
+    // Imported images are owned outside the graph and discarded on entry: their first access
+    // transitions from UNDEFINED. wait_stage is the stage the submit waits for the image at (the
+    // acquire semaphore's stage for swapchain images). The graph leaves them in final_access.
+    ResourceId import_image(std::string name, vk::PipelineStageFlags2 wait_stage, ResourceAccess final_access);
+    ResourceId import_buffer(std::string name);
+    ResourceId create_image(std::string name, const TransientImageDesc& desc);
+
+    PassBuilder add_pass(std::string name, Execute execute);
+
+    // Throws on a resource accessed twice by one pass or a transient read before it is written.
+    void compile(const vk::Device& device, GpuAllocator& allocator);
+    void destroy(GpuAllocator& allocator);
+
+    void set_image(ResourceId resource, vk::Image image, vk::ImageView view);
+    void set_buffer(ResourceId resource, vk::Buffer buffer);
+    vk::Image image(ResourceId resource) const { return m_resources[resource].image; }
+    vk::ImageView view(ResourceId resource) const { return m_resources[resource].view; }
+    vk::Buffer buffer(ResourceId resource) const { return m_resources[resource].buffer; }
+
+    void execute(const vk::CommandBuffer& cmd) const;
+
+    const RenderGraphStats& stats() const { return m_stats; }
+
+private:
+    struct Resource {
+        std::string name;
+        bool is_image = true;
+        bool imported = false;
+        vk::PipelineStageFlags2 wait_stage;
+        ResourceAccess final_access = ResourceAccess::Present;
+        TransientImageDesc desc{};
+
+        vk::Image image;
+        vk::ImageView view;
+        vk::Buffer buffer;
+        vk::DeviceSize memory_offset = 0;
+    };
+
+    struct Use {
+        ResourceId resource;
+        ResourceAccess access;
+    };
+
+    struct Barrier {
+        ResourceId resource;
+        vk::PipelineStageFlags2 src_stages;
+        vk::AccessFlags2 src_access;
+        vk::PipelineStageFlags2 dst_stages;
+        vk::AccessFlags2 dst_access;
+        vk::ImageLayout old_layout;
+        vk::ImageLayout new_layout;
+    };
+
+    struct Pass {
+        std::string name;
+        Execute execute;
+        std::vector<Use> uses;
+        bool side_effect = false;
+        bool live = false;
+        std::vector<Barrier> barriers;
+    };
+
+    void cull_passes();
+    void allocate_transients(GpuAllocator& allocator);
+    void plan_barriers();
+    void record_barriers(const vk::CommandBuffer& cmd, const std::vector<Barrier>& barriers) const;
+
+    vk::Device m_device;
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<Barrier> m_final_barriers;
+    Allocation m_transient_memory;
+    RenderGraphStats m_stats;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+
+// A read-only memory mapping of one .spv file. The mapping is page aligned, so the words can be
+// handed to vkCreateShaderModule directly without copying them onto the heap.
+class MappedSpirv {
+public:
+    explicit MappedSpirv(const std::string& path);
+    ~MappedSpirv();
+
+    MappedSpirv(const MappedSpirv&) = delete;
+    MappedSpirv& operator=(const MappedSpirv&) = delete;
+
+    std::span<const uint32_t> code() const;
+
+private:
+    const void* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+// An external shader pack: a directory of <name>.spv files, mapped lazily on first use.
+class ShaderPack {
+public:
+    explicit ShaderPack(std::string directory);
+
+    std::span<const uint32_t> get(const std::string& name);
+
+private:
+    std::string m_directory;
+    std::map<std::string, std::unique_ptr<MappedSpirv>> m_shaders;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Shader file name (e.g. "shader.frag") to freshly compiled SPIR-V.
+using ShaderChanges = std::map<std::string, std::vector<uint32_t>>;
+
+struct ShaderReloadStats {
+    uint64_t compiled = 0;
+    uint64_t failed = 0;
+};
+
+// Watches a directory of GLSL sources and recompiles the ones that change on its own thread,
+// with the same glslc the build uses. Each poll that compiles anything calls rebuild, still on
+// the watcher thread, with every shader that compiled cleanly; compiler errors are printed and
+// the shader keeps its previous code until the next successful save.
+class ShaderReloader {
+public:
+    using Rebuild = std::function<void(const ShaderChanges& changed)>;
+
+    static constexpr std::chrono::milliseconds poll_interval{ 250 };
+
+    ~ShaderReloader() { stop(); }
+
+    // Sources present at start count as current; only later modifications are compiled.
+    void start(std::filesystem::path source_dir, std::string compiler, Rebuild rebuild);
+    void stop();
+
+    bool running() const { return m_thread.joinable(); }
+    ShaderReloadStats stats() const;
+
+private:
+    void watch();
+    bool compile(const std::filesystem::path& source, std::vector<uint32_t>& code);
+
+    std::filesystem::path m_source_dir;
+    std::filesystem::path m_output_dir;
+    std::string m_compiler;
+    Rebuild m_rebuild;
+    std::map<std::filesystem::path, std::filesystem::file_time_type> m_write_times;
+
+    std::thread m_thread;
+    bool m_stop = false;
+    ShaderReloadStats m_stats;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
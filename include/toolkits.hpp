@@ -1,7 +1,9 @@
 #pragma once
 
 #include <vk.hpp>
+#include <debug_sink.hpp>
 #include <optional>
+#include <span>
 
 const std::vector<const char*> validation_layers = {
     "VK_LAYER_KHRONOS_validation"
@@ -17,10 +19,15 @@ const std::vector<const char*> device_extensions = {
     const bool enable_validation_layers = true;
 #endif
 
+// Without a surface (offscreen rendering) the graphics family doubles as the present family.
 struct QueueFamilyIndices {
-    static QueueFamilyIndices find_queue_families(const vk::PhysicalDevice&, const vk::SurfaceKHR& surface);
+    static QueueFamilyIndices find_queue_families(const vk::PhysicalDevice&, std::span<const vk::QueueFamilyProperties> families,
+                                                  const vk::SurfaceKHR& surface);
     std::optional<uint32_t> graphics;
     std::optional<uint32_t> present;
+    // Async compute and transfer families, left empty when the device only has the graphics family.
+    std::optional<uint32_t> compute;
+    std::optional<uint32_t> transfer;
     bool satisfied_all() const;
 };
 
@@ -30,27 +37,70 @@ struct SwapChainSupportDetails {
     std::vector<vk::PresentModeKHR> present_modes;
 };
 
+// Everything startup asks the driver about one physical device. Queried once per device during
+// selection and then reused by device, swapchain and frame creation instead of asking again.
+struct DeviceCapabilities {
+    static DeviceCapabilities query(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface);
+    bool has_extension(const char* extension_name) const;
+
+    vk::PhysicalDevice device;
+    vk::PhysicalDeviceProperties properties;
+    // Descriptor indexing limits among others; pNext is cleared like vulkan12_features.
+    vk::PhysicalDeviceVulkan12Properties vulkan12_properties;
+    vk::PhysicalDeviceFeatures features;
+    // pNext is cleared, so the struct can be copied around on its own.
+    vk::PhysicalDeviceVulkan12Features vulkan12_features;
+    // All false on devices below Vulkan 1.3.
+    vk::PhysicalDeviceVulkan13Features vulkan13_features;
+    vk::PhysicalDeviceMemoryProperties memory_properties;
+    std::vector<vk::ExtensionProperties> extensions;
+    std::vector<vk::QueueFamilyProperties> queue_family_properties;
+    QueueFamilyIndices queue_families;
+    // VK_KHR_present_id and VK_KHR_present_wait, both extensions and both features.
+    bool present_wait = false;
+    // VK_EXT_memory_budget, enabled whenever it is there.
+    bool memory_budget = false;
+    // Left empty without a surface or without the swapchain extension.
+    SwapChainSupportDetails swapchain_support;
+};
+
 VKAPI_ATTR VkResult VKAPI_CALL vkCreateDebugUtilsMessengerEXT(VkInstance instance,
                                                               const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
                                                               const VkAllocationCallbacks *pAllocator,
                                                               VkDebugUtilsMessengerEXT *pMessenger);
 VKAPI_ATTR void VKAPI_CALL vkDestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT messenger,
                                                            VkAllocationCallbacks const *pAllocator);
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateHeadlessSurfaceEXT(VkInstance instance,
+                                                          const VkHeadlessSurfaceCreateInfoEXT *pCreateInfo,
+                                                          const VkAllocationCallbacks *pAllocator,
+                                                          VkSurfaceKHR *pSurface);
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForPresentKHR(VkDevice device, VkSwapchainKHR swapchain,
+                                                   uint64_t presentId, uint64_t timeout);
 void VkToolMakeDebugUtilsMessengerEXT(const vk::Instance& inst);
+void VkToolMakeHeadlessSurfaceEXT(const vk::Instance& inst);
+void VkToolMakePresentWaitKHR(const vk::Device& device);
 bool check_validation_layers();
-std::vector<const char*> get_required_extensions();
+bool check_instance_extension_support(const char* extension_name);
+// Headless instances skip GLFW entirely and only ask for VK_EXT_headless_surface when the loader has it.
+std::vector<const char*> get_required_extensions(bool headless, bool use_headless_surface);
 VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     VkDebugUtilsMessageSeverityFlagBitsEXT severity,
     VkDebugUtilsMessageTypeFlagsEXT type,
     const VkDebugUtilsMessengerCallbackDataEXT* p_callback_data,
     void* p_user_data);
-vk::DebugUtilsMessengerCreateInfoEXT get_messenger_create_info();
-bool is_device_suitable(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface);
-bool check_device_extensions_support(const vk::PhysicalDevice& device);
+// Messages go to sink when given, otherwise errors are written to std::cerr on the calling thread.
+vk::DebugUtilsMessengerCreateInfoEXT get_messenger_create_info(DebugMessageSink* sink = nullptr);
+bool is_device_suitable(const DeviceCapabilities& caps, const vk::SurfaceKHR& surface);
+bool check_device_extensions_support(const DeviceCapabilities& caps);
+// Higher is better: device type first, then device-local memory, limits and optional features.
+uint64_t rate_device(const DeviceCapabilities& caps);
+uint32_t find_memory_type(const vk::PhysicalDevice& phy_device, uint32_t type_bits, vk::MemoryPropertyFlags properties);
+uint32_t find_memory_type(const vk::PhysicalDeviceMemoryProperties& memory_properties, uint32_t type_bits, vk::MemoryPropertyFlags properties);
 SwapChainSupportDetails query_swapchain_support(const vk::PhysicalDevice& phy_device, const vk::SurfaceKHR& surface);
 
 vk::SurfaceFormatKHR choose_surface_format(const std::vector<vk::SurfaceFormatKHR>& formats);
-vk::PresentModeKHR choose_present_mode(const std::vector<vk::PresentModeKHR>& modes);
-vk::Extent2D choose_extent(const vk::SurfaceCapabilitiesKHR& capabilities, GLFWwindow* window);
+// The preferred mode when the surface offers it, otherwise FIFO, which every surface supports.
+vk::PresentModeKHR choose_present_mode(const std::vector<vk::PresentModeKHR>& modes, vk::PresentModeKHR preferred);
+vk::Extent2D choose_extent(const vk::SurfaceCapabilitiesKHR& capabilities, GLFWwindow* window, vk::Extent2D headless_extent);
 std::vector<char> read_file(const char* filename);
-vk::ShaderModule create_shader_module(const vk::Device& device, const std::vector<char>& buffer);
+vk::ShaderModule create_shader_module(const vk::Device& device, std::span<const uint32_t> code);
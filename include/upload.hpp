@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vk.hpp>
+#include <allocator.hpp>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Every stage that may read an uploaded resource. Graphics submissions wait on the upload
+// timeline at these stages.
+inline constexpr vk::PipelineStageFlags upload_consumer_stages = vk::PipelineStageFlagBits::eDrawIndirect
+                                                               | vk::PipelineStageFlagBits::eVertexInput
+                                                               | vk::PipelineStageFlagBits::eVertexShader
+                                                               | vk::PipelineStageFlagBits::eFragmentShader
+                                                               | vk::PipelineStageFlagBits::eComputeShader;
+
+// Streams buffer and image data to the GPU through a persistently mapped staging ring.
+// Copies are batched and submitted together on the transfer queue, and each batch signals
+// the next value of a timeline semaphore. When the transfer family differs from the graphics
+// family, the batch releases ownership, and record_acquires() performs the matching acquire
+// on the graphics side.
+class UploadService {
+public:
+    void init(const vk::Device& device, const DeviceCapabilities& caps, GpuAllocator& allocator,
+              const vk::Queue& transfer_queue, uint32_t transfer_family, uint32_t graphics_family,
+              vk::DeviceSize staging_size = 64 * 1024 * 1024);
+    void destroy();
+
+    // The data is copied into staging memory immediately, so callers may free it on return.
+    void upload_buffer(const vk::Buffer& dst, vk::DeviceSize dst_offset, const void* data, vk::DeviceSize size);
+    // The same for data of any size: the staging ring is fixed, so it goes up in pieces.
+    void upload_buffer_chunked(const vk::Buffer& dst, vk::DeviceSize dst_offset, const void* data, vk::DeviceSize size);
+    // Uploads mip 0 of a single-layer color image and leaves it in final_layout.
+    void upload_image(const vk::Image& dst, vk::Extent3D extent, const void* data, vk::DeviceSize size,
+                      vk::ImageLayout final_layout);
+
+    // Submits everything queued since the last flush. Returns the timeline value that signals
+    // completion, or the previous value when nothing was queued.
+    uint64_t flush();
+
+    bool is_complete(uint64_t value) const;
+    void wait(uint64_t value) const;
+
+    // Graphics side, once per submission: records ownership acquires for every flushed batch not
+    // acquired yet, or a barrier chaining onto them while the last batch is still in flight, and
+    // returns the timeline value the submission has to wait for (0 once that batch completed).
+    uint64_t record_acquires(const vk::CommandBuffer& cmd);
+
+    vk::Semaphore timeline() const { return m_timeline; }
+    uint64_t last_submitted() const { return m_submitted_value; }
+
+private:
+    struct Batch {
+        vk::CommandBuffer cmd;
+        uint64_t value = 0;
+        vk::DeviceSize ring_end = 0;
+    };
+
+    vk::DeviceSize reserve(vk::DeviceSize size);
+    void reclaim();
+    void begin_batch();
+    uint64_t submit_locked();
+
+    vk::Device m_device;
+    GpuAllocator* m_allocator = nullptr;
+    vk::Queue m_queue;
+    uint32_t m_transfer_family = 0;
+    uint32_t m_graphics_family = 0;
+    vk::CommandPool m_command_pool;
+    vk::Semaphore m_timeline;
+
+    AllocatedBuffer m_staging;
+    vk::DeviceSize m_staging_size = 0;
+    vk::DeviceSize m_alignment = 16;
+    vk::DeviceSize m_head = 0;
+    vk::DeviceSize m_tail = 0;
+
+    vk::CommandBuffer m_recording;
+    std::deque<Batch> m_in_flight;
+    std::vector<vk::CommandBuffer> m_free_cmds;
+    uint64_t m_submitted_value = 0;
+
+    std::vector<vk::BufferMemoryBarrier> m_pending_buffer_acquires;
+    std::vector<vk::ImageMemoryBarrier> m_pending_image_acquires;
+    std::vector<vk::BufferMemoryBarrier> m_buffer_acquires;
+    std::vector<vk::ImageMemoryBarrier> m_image_acquires;
+    uint64_t m_acquire_value = 0;
+
+    mutable std::mutex m_mutex;
+};
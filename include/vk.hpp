@@ -1,10 +1,7 @@
 #pragma once
-#define VK_USE_PLATFORM_WIN32_KHR
 #define GLFW_INCLUDE_VULKAN
-#include <glfw/glfw3.h>
-#define GLFW_EXPOSE_NATIVE_WIN32
-#include <GLFW/glfw3native.h>
+#include <GLFW/glfw3.h>
 // #define VULKAN_HPP_NO_EXCEPTIONS
 #define VULKAN_HPP_TYPESAFE_CONVERSION
 #define VULKAN_HPP_NO_CONSTRUCTORS
-#include <vulkan/vulkan.hpp>
\ No newline at end of file
+#include <vulkan/vulkan.hpp>
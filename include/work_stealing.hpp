@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent workers that each own a deque of slice indices. A worker pops from the back of its
+// own deque and steals from the front of the others once it runs dry, so uneven slices still
+// balance across threads.
+class WorkStealingScheduler {
+public:
+    using Job = std::function<void(uint32_t worker, uint32_t slice)>;
+
+    explicit WorkStealingScheduler(size_t thread_count = std::thread::hardware_concurrency());
+    ~WorkStealingScheduler();
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    // Blocks until job has run for every slice in [0, slice_count). Rethrows the first exception.
+    void parallel_for(uint32_t slice_count, Job job);
+
+    uint32_t size() const { return static_cast<uint32_t>(m_threads.size()); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<uint32_t> slices;
+    };
+
+    void worker(uint32_t index);
+    bool pop(uint32_t worker, uint32_t& slice);
+    bool steal(uint32_t worker, uint32_t& slice);
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    Job m_job;
+    std::atomic<uint32_t> m_remaining{ 0 };
+    std::exception_ptr m_error;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+};
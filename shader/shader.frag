@@ -4,6 +4,9 @@ layout(location = 0) in vec3 FragColor;
 
 layout(location = 0) out vec4 PixelColor;
 
+// Specialized per blend variant; opaque pipelines keep the default.
+layout(constant_id = 0) const float ALPHA = 1.0;
+
 void main() {
-    PixelColor = vec4(FragColor, 1.0);
+    PixelColor = vec4(FragColor, ALPHA);
 }
\ No newline at end of file
@@ -1,20 +1,15 @@
 #version 460
 
-layout(location = 0) out vec3 FragColor;
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec4 Color;
 
-vec2 Positions[3] = vec2[] (
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// Per instance: xy offset and uniform scale, plus a tint.
+layout(location = 2) in vec3 InstanceTransform;
+layout(location = 3) in vec4 InstanceColor;
 
-vec3 Colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) out vec3 FragColor;
 
 void main() {
-    gl_Position = vec4(Positions[gl_VertexIndex], 0.0, 1.0);
-    FragColor = Colors[gl_VertexIndex];
-}
\ No newline at end of file
+    gl_Position = vec4(Position * InstanceTransform.z + InstanceTransform.xy, 0.0, 1.0);
+    FragColor = Color.rgb * InstanceColor.rgb;
+}
@@ -0,0 +1,346 @@
+#include <allocator.hpp>
+#include <toolkits.hpp>
+
+#include <algorithm>
+
+namespace {
+
+constexpr vk::DeviceSize mebibyte = 1024 * 1024;
+constexpr vk::DeviceSize max_block_size = 256 * mebibyte;
+constexpr vk::DeviceSize min_block_size = 4 * mebibyte;
+
+vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+}
+
+FreeList::FreeList(vk::DeviceSize size)
+    : m_size(size), m_free_bytes(size) {
+    if (size > 0)
+        m_ranges.emplace(0, size);
+}
+
+bool FreeList::allocate(vk::DeviceSize size, vk::DeviceSize alignment, 
+                        vk::DeviceSize& offset, vk::DeviceSize& range_offset, vk::DeviceSize& range_size) {
+    auto best = m_ranges.end();
+    vk::DeviceSize best_waste = 0;
+
+    for (auto it = m_ranges.begin(); it != m_ranges.end(); ++it) {
+        vk::DeviceSize aligned = align_up(it->first, alignment);
+        if (aligned + size > it->first + it->second)
+            continue;
+
+        vk::DeviceSize waste = it->second - size;
+        if (best == m_ranges.end() || waste < best_waste) {
+            best = it;
+            best_waste = waste;
+            if (waste == aligned - it->first)
+                break;
+        }
+    }
+
+    if (best == m_ranges.end())
+        return false;
+
+    vk::DeviceSize start = best->first;
+    vk::DeviceSize end = best->first + best->second;
+    offset = align_up(start, alignment);
+    range_offset = start;
+    range_size = offset + size - start;
+
+    m_ranges.erase(best);
+    if (offset + size < end)
+        m_ranges.emplace(offset + size, end - offset - size);
+
+    m_free_bytes -= range_size;
+    return true;
+}
+
+void FreeList::release(vk::DeviceSize range_offset, vk::DeviceSize range_size) {
+    m_free_bytes += range_size;
+
+    auto next = m_ranges.lower_bound(range_offset);
+    if (next != m_ranges.end() && range_offset + range_size == next->first) {
+        range_size += next->second;
+        next = m_ranges.erase(next);
+    }
+
+    if (next != m_ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == range_offset) {
+            prev->second += range_size;
+            return;
+        }
+    }
+
+    m_ranges.emplace_hint(next, range_offset, range_size);
+}
+
+vk::DeviceSize FreeList::largest_free_range() const {
+    vk::DeviceSize largest = 0;
+    for (const auto& [offset, size] : m_ranges)
+        largest = std::max(largest, size);
+    return largest;
+}
+
+bool FreeList::empty() const {
+    return m_free_bytes == m_size;
+}
+
+void GpuAllocator::init(const vk::Device& device, const DeviceCapabilities& caps) {
+    m_device = device;
+    m_memory_properties = caps.memory_properties;
+    m_max_allocation_count = caps.properties.limits.maxMemoryAllocationCount;
+}
+
+void GpuAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& block : m_blocks) {
+        if (block.memory)
+            m_device.freeMemory(block.memory);
+    }
+    m_blocks.clear();
+    m_free_block_slots.clear();
+    m_heap_reserved.fill(0);
+    m_device_allocation_count = 0;
+}
+
+vk::DeviceSize GpuAllocator::block_size_for(uint32_t memory_type) const {
+    // Small heaps (e.g. the 256 MiB BAR window) get proportionally smaller blocks.
+    uint32_t heap = m_memory_properties.memoryTypes[memory_type].heapIndex;
+    vk::DeviceSize heap_size = m_memory_properties.memoryHeaps[heap].size;
+    return std::clamp(align_up(heap_size / 8, mebibyte), min_block_size, max_block_size);
+}
+
+uint32_t GpuAllocator::create_block(uint32_t memory_type, ResourceKind kind, vk::DeviceSize size, bool dedicated) {
+    if (m_device_allocation_count >= m_max_allocation_count)
+        throw std::runtime_error("Exceeded maxMemoryAllocationCount");
+
+    vk::MemoryAllocateInfo alloc_info {
+        .allocationSize = size,
+        .memoryTypeIndex = memory_type
+    };
+
+    Block block {
+        .memory = m_device.allocateMemory(alloc_info),
+        .size = size,
+        .memory_type = memory_type,
+        .kind = kind,
+        .dedicated = dedicated,
+        .free_list = FreeList(size)
+    };
+    ++m_device_allocation_count;
+    m_heap_reserved[m_memory_properties.memoryTypes[memory_type].heapIndex] += size;
+
+    if (m_memory_properties.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        block.mapped = m_device.mapMemory(block.memory, 0, VK_WHOLE_SIZE);
+
+    if (!m_free_block_slots.empty()) {
+        uint32_t index = m_free_block_slots.back();
+        m_free_block_slots.pop_back();
+        m_blocks[index] = std::move(block);
+        return index;
+    }
+
+    m_blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+void GpuAllocator::release_block(uint32_t index) {
+    Block& block = m_blocks[index];
+    m_device.freeMemory(block.memory);
+    --m_device_allocation_count;
+    m_heap_reserved[m_memory_properties.memoryTypes[block.memory_type].heapIndex] -= block.size;
+    block = Block{};
+    m_free_block_slots.push_back(index);
+}
+
+Allocation GpuAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties,
+                                  ResourceKind kind) {
+    uint32_t memory_type = find_memory_type(m_memory_properties, requirements.memoryTypeBits, properties);
+    if (m_budget_check)
+        m_budget_check(m_memory_properties.memoryTypes[memory_type].heapIndex, requirements.size);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto finish = [&](uint32_t index, vk::DeviceSize offset, vk::DeviceSize range_offset, vk::DeviceSize range_size) {
+        Block& block = m_blocks[index];
+        block.used_bytes += requirements.size;
+        block.wasted_bytes += range_size - requirements.size;
+        ++block.allocation_count;
+        return Allocation {
+            .memory = block.memory,
+            .offset = offset,
+            .size = requirements.size,
+            .mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr,
+            .block = index,
+            .range_offset = range_offset,
+            .range_size = range_size
+        };
+    };
+
+    vk::DeviceSize block_size = block_size_for(memory_type);
+    vk::DeviceSize offset, range_offset, range_size;
+
+    // Anything over half a block would mostly waste a shared block, so it gets its own.
+    if (requirements.size > block_size / 2) {
+        uint32_t index = create_block(memory_type, kind, requirements.size, true);
+        m_blocks[index].free_list.allocate(requirements.size, 1, offset, range_offset, range_size);
+        return finish(index, offset, range_offset, range_size);
+    }
+
+    for (uint32_t i = 0; i < m_blocks.size(); ++i) {
+        Block& block = m_blocks[i];
+        if (!block.memory || block.dedicated || block.memory_type != memory_type || block.kind != kind)
+            continue;
+        if (block.free_list.allocate(requirements.size, requirements.alignment, offset, range_offset, range_size))
+            return finish(i, offset, range_offset, range_size);
+    }
+
+    uint32_t index = create_block(memory_type, kind, block_size, false);
+    if (!m_blocks[index].free_list.allocate(requirements.size, requirements.alignment, offset, range_offset, range_size))
+        throw std::runtime_error("Allocation does not fit into a fresh memory block");
+    return finish(index, offset, range_offset, range_size);
+}
+
+void GpuAllocator::free(const Allocation& allocation) {
+    if (allocation.block == ~0u) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Block& block = m_blocks[allocation.block];
+    block.free_list.release(allocation.range_offset, allocation.range_size);
+    block.used_bytes -= allocation.size;
+    block.wasted_bytes -= allocation.range_size - allocation.size;
+    --block.allocation_count;
+
+    // Shared blocks are kept around once created so steady-state churn never reaches the driver.
+    if (block.dedicated)
+        release_block(allocation.block);
+}
+
+AllocatedBuffer GpuAllocator::create_buffer(const vk::BufferCreateInfo& create_info, vk::MemoryPropertyFlags properties) {
+    AllocatedBuffer result;
+    result.buffer = m_device.createBuffer(create_info);
+    try {
+        result.allocation = allocate(m_device.getBufferMemoryRequirements(result.buffer), properties, ResourceKind::Linear);
+    } catch (...) {
+        m_device.destroyBuffer(result.buffer);
+        throw;
+    }
+    m_device.bindBufferMemory(result.buffer, result.allocation.memory, result.allocation.offset);
+    return result;
+}
+
+void GpuAllocator::destroy_buffer(const AllocatedBuffer& buffer) {
+    m_device.destroyBuffer(buffer.buffer);
+    free(buffer.allocation);
+}
+
+AllocatedImage GpuAllocator::create_image(const vk::ImageCreateInfo& create_info, vk::MemoryPropertyFlags properties) {
+    ResourceKind kind = create_info.tiling == vk::ImageTiling::eOptimal ? ResourceKind::Optimal : ResourceKind::Linear;
+
+    AllocatedImage result;
+    result.image = m_device.createImage(create_info);
+    try {
+        result.allocation = allocate(m_device.getImageMemoryRequirements(result.image), properties, kind);
+    } catch (...) {
+        m_device.destroyImage(result.image);
+        throw;
+    }
+    m_device.bindImageMemory(result.image, result.allocation.memory, result.allocation.offset);
+    return result;
+}
+
+void GpuAllocator::destroy_image(const AllocatedImage& image) {
+    m_device.destroyImage(image.image);
+    free(image.allocation);
+}
+
+vk::DeviceSize GpuAllocator::reserved_bytes(uint32_t heap) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_heap_reserved[heap];
+}
+
+vk::DeviceSize GpuAllocator::trim(uint32_t heap) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    vk::DeviceSize freed = 0;
+    for (uint32_t i = 0; i < m_blocks.size(); ++i) {
+        const Block& block = m_blocks[i];
+        if (!block.memory || block.dedicated || block.allocation_count > 0
+            || m_memory_properties.memoryTypes[block.memory_type].heapIndex != heap)
+            continue;
+        freed += block.size;
+        release_block(i);
+    }
+    return freed;
+}
+
+AllocatorStats GpuAllocator::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    AllocatorStats stats;
+    for (const auto& block : m_blocks) {
+        if (!block.memory) continue;
+        ++stats.block_count;
+        stats.reserved_bytes += block.size;
+        stats.used_bytes += block.used_bytes;
+        stats.wasted_bytes += block.wasted_bytes;
+        stats.free_bytes += block.free_list.free_bytes();
+        stats.allocation_count += block.allocation_count;
+        stats.largest_free_range = std::max(stats.largest_free_range, block.free_list.largest_free_range());
+    }
+
+    if (stats.free_bytes > 0)
+        stats.fragmentation = 1.0 - static_cast<double>(stats.largest_free_range) / stats.free_bytes;
+    return stats;
+}
+
+void RingAllocator::init(GpuAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, uint32_t frames_in_flight) {
+    vk::BufferCreateInfo buffer_create_info {
+        .size = size,
+        .usage = usage,
+        .sharingMode = vk::SharingMode::eExclusive
+    };
+
+    m_buffer = allocator.create_buffer(buffer_create_info, 
+                                       vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    m_size = size;
+    m_head = m_tail = m_wasted = 0;
+    m_frame_end.assign(frames_in_flight, 0);
+    m_current_frame = ~0u;
+}
+
+void RingAllocator::destroy(GpuAllocator& allocator) {
+    allocator.destroy_buffer(m_buffer);
+    m_buffer = AllocatedBuffer{};
+}
+
+void RingAllocator::begin_frame(uint32_t frame_index) {
+    if (m_current_frame != ~0u)
+        m_frame_end[m_current_frame] = m_head;
+    m_current_frame = frame_index;
+    m_tail = std::max(m_tail, m_frame_end[frame_index]);
+}
+
+RingAllocation RingAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    // Align the physical offset, and skip to the start of the buffer when the request would straddle its end.
+    vk::DeviceSize offset = align_up(m_head % m_size, alignment);
+    if (offset + size > m_size)
+        offset = 0;
+    vk::DeviceSize position = offset == 0 && m_head % m_size != 0 
+        ? align_up(m_head, m_size) 
+        : m_head - m_head % m_size + offset;
+
+    if (size > m_size || position + size - m_tail > m_size)
+        throw std::runtime_error("Ring allocator exhausted");
+
+    m_wasted += position - m_head;
+    m_head = position + size;
+
+    return RingAllocation {
+        .buffer = m_buffer.buffer,
+        .offset = offset,
+        .mapped = static_cast<char*>(m_buffer.allocation.mapped) + offset
+    };
+}
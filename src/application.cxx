@@ -1,10 +1,59 @@
 #include <application.hpp>
 #include <toolkits.hpp>
+#include <spirv/shader_vert.hpp>
+#include <spirv/shader_frag.hpp>
 
 #include <cstdint>
 #include <limits>
 #include <set>
 #include <array>
+#include <algorithm>
+#include <string_view>
+#include <future>
+#include <cmath>
+
+namespace {
+
+// Hot-reload rebuilds compile on their own small pool.
+constexpr size_t reload_threads = 2;
+
+struct SceneVertex {
+    float position[2];
+    uint8_t color[4];
+};
+
+struct SceneInstance {
+    float transform[3];
+    uint8_t color[4];
+};
+
+// Must match the inputs of shader.vert.
+VertexFormat scene_vertex_format() {
+    return VertexFormat {
+        .streams = {
+            VertexStream {
+                .input_rate = vk::VertexInputRate::eVertex,
+                .attributes = {
+                    { 0, vk::Format::eR32G32Sfloat },
+                    { 1, vk::Format::eR8G8B8A8Unorm }
+                }
+            },
+            VertexStream {
+                .input_rate = vk::VertexInputRate::eInstance,
+                .attributes = {
+                    { 2, vk::Format::eR32G32B32Sfloat },
+                    { 3, vk::Format::eR8G8B8A8Unorm }
+                }
+            }
+        }
+    };
+}
+
+}
+
+Application::Application(const ApplicationConfig& config)
+    : m_config(config) {
+}
 
 void Application::run() {
     init();
@@ -17,54 +66,569 @@ void Application::init() {
     init_vulkan();
 }
 
+// Only initializes the library; the window itself is created by init_vulkan() while the
+// instance is being created on another thread.
 void Application::init_glfw() {
-    const uint32_t height = 600;
-    const uint32_t width = 800;
+    if (m_config.headless) return;
+
+    if (!glfwInit())
+        throw std::runtime_error("Can't initialize GLFW");
+}
+
+void Application::create_window() {
+    if (m_config.headless) return;
 
-    glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-    m_window = glfwCreateWindow(width, height, "Vulkan Window", nullptr, nullptr);
+    m_window = glfwCreateWindow(m_config.width, m_config.height, "Vulkan Window", nullptr, nullptr);
+    glfwSetWindowUserPointer(m_window, this);
+    glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow* window, int, int) {
+        static_cast<Application*>(glfwGetWindowUserPointer(window))->m_swapchain_dirty = true;
+    });
+    glfwSetKeyCallback(m_window, [](GLFWwindow* window, int key, int, int action, int) {
+        if (action != GLFW_PRESS) return;
+
+        auto app = static_cast<Application*>(glfwGetWindowUserPointer(window));
+        uint32_t image_count = static_cast<uint32_t>(app->m_images.size());
+        switch (key) {
+            case GLFW_KEY_1: app->set_present_mode(vk::PresentModeKHR::eFifo); break;
+            case GLFW_KEY_2: app->set_present_mode(vk::PresentModeKHR::eFifoRelaxed); break;
+            case GLFW_KEY_3: app->set_present_mode(vk::PresentModeKHR::eMailbox); break;
+            case GLFW_KEY_4: app->set_present_mode(vk::PresentModeKHR::eImmediate); break;
+            case GLFW_KEY_EQUAL:
+            case GLFW_KEY_KP_ADD: app->set_swapchain_image_count(image_count + 1); break;
+            case GLFW_KEY_MINUS:
+            case GLFW_KEY_KP_SUBTRACT: app->set_swapchain_image_count(std::max(image_count, 2u) - 1); break;
+            default: break;
+        }
+    });
     int w, h;
     glfwGetWindowSize(m_window, &w, &h);
     std::cout << "w:" << w << " h:" << h << "\n";
 }
 
 void Application::mainloop() {
-    while (!glfwWindowShouldClose(m_window)) {
-        glfwPollEvents();
+    auto start = Clock::now();
+    m_window_start = start;
+
+    while (!should_stop()) {
+        if (m_window) {
+            glfwPollEvents();
+
+            // A minimized window has nothing to render into; sleep until it comes back.
+            int width = 0, height = 0;
+            glfwGetFramebufferSize(m_window, &width, &height);
+            if (width == 0 || height == 0) {
+                glfwWaitEvents();
+                continue;
+            }
+        }
+        m_input_time = Clock::now();
+        draw_frame();
+    }
+    m_device.waitIdle();
+    m_readback.flush();
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (seconds <= 0.0 || m_frame_number == 0) return;
+
+    m_run_stats = FrameStats {
+        .frames = m_frame_number,
+        .fps = m_frame_number / seconds,
+        .cpu_ms = m_run_cpu_ms / m_frame_number,
+        .record_ms = m_run_record_ms / m_frame_number,
+        .gpu_ms = m_run_gpu_samples ? m_run_gpu_ms / m_run_gpu_samples : 0.0
+    };
+    FrameTimeStats frame_times = m_profiler.frame_time_stats();
+    std::cout << "Rendered " << m_frame_number << " frames, " 
+              << m_run_stats.fps << " fps sustained, frame time p50 " << frame_times.p50_ms 
+              << " ms p99 " << frame_times.p99_ms << " ms\n";
+    for (const auto& latency : m_latency.stats()) {
+        std::cout << "Input-to-" << (m_present_wait ? "present" : "GPU-complete") << " latency " << latency.mode 
+                  << ": p50 " << latency.latency.p50_ms << " ms p99 " << latency.latency.p99_ms 
+                  << " ms (" << latency.latency.samples << " frames)\n";
+    }
+    if (m_readback.enabled())
+        std::cout << "Read back " << m_readback.delivered() << " frames\n";
+    DeletionStats deletions = m_deletion_queue.stats();
+    if (deletions.queued > 0)
+        std::cout << "Deferred " << deletions.queued << " destructions, released " << deletions.released
+                  << " in " << deletions.batches << " batches\n";
+
+    constexpr double mebibyte = 1024.0 * 1024.0;
+    MemoryBudgetStats budget = m_memory_budget.stats();
+    std::vector<HeapBudget> heaps = m_memory_budget.heaps();
+    for (size_t i = 0; i < heaps.size(); ++i) {
+        if (heaps[i].peak_usage == 0) continue;
+        std::cout << "Memory heap " << i << (heaps[i].device_local ? " (device local)" : "") << ": peak "
+                  << heaps[i].peak_usage / mebibyte << " MiB of a " << heaps[i].budget / mebibyte << " MiB budget"
+                  << (budget.estimated ? " (estimated)" : "") << "\n";
+    }
+    if (budget.evictions > 0) {
+        std::cout << budget.evictions << " eviction passes (" << budget.allocation_evictions << " before allocations) released "
+                  << budget.evicted_bytes / mebibyte << " MiB\n";
+        for (const auto& handler : budget.handlers)
+            std::cout << "  " << handler.name << ": " << handler.released_bytes / mebibyte << " MiB\n";
     }
 }
 
+void Application::set_present_mode(vk::PresentModeKHR mode) {
+    m_config.present_mode = mode;
+    m_swapchain_dirty = true;
+}
+
+void Application::set_swapchain_image_count(uint32_t count) {
+    m_config.swapchain_image_count = count;
+    m_swapchain_dirty = true;
+}
+
+bool Application::should_stop() const {
+    uint64_t max_frames = m_config.max_frames;
+    if (!m_window && max_frames == 0)
+        max_frames = 1000;
+
+    if (max_frames > 0 && m_frame_number >= max_frames)
+        return true;
+
+    return m_window && glfwWindowShouldClose(m_window);
+}
+
+void Application::draw_frame() {
+    uint32_t frame_index = static_cast<uint32_t>(m_frame_number % m_frames.size());
+    FrameContext& frame = m_frames[frame_index];
+
+    auto frame_start = Clock::now();
+    {
+        auto scope = m_profiler.cpu_scope("wait_frame_fence");
+        if (m_device.waitForFences(frame.in_flight, true, UINT64_MAX) != vk::Result::eSuccess)
+            throw std::runtime_error("Failed to wait for frame fence");
+    }
+
+    auto cpu_start = Clock::now();
+    poll_latency();
+    if (m_frame_number >= m_frames.size())
+        m_deletion_queue.collect(m_frame_number - m_frames.size());
+    swap_reloaded_pipelines();
+    m_memory_budget.update();
+    if (m_swapchain && m_swapchain_dirty)
+        recreate_swapchain();
+
+    uint32_t image_index;
+    if (m_swapchain) {
+        auto scope = m_profiler.cpu_scope("acquire_image");
+        try {
+            auto acquired = m_device.acquireNextImageKHR(m_swapchain, UINT64_MAX, frame.image_available, nullptr);
+            image_index = acquired.value;
+            if (acquired.result == vk::Result::eSuboptimalKHR)
+                m_swapchain_dirty = true;
+        } catch (const vk::OutOfDateKHRError&) {
+            // Nothing was acquired or signaled; the fence is still signaled, so the next call
+            // recreates the swapchain and tries again.
+            m_swapchain_dirty = true;
+            return;
+        }
+    } else {
+        image_index = static_cast<uint32_t>(m_frame_number % m_images.size());
+    }
+
+    if (frame.submitted) {
+        // Every frame up to the one this context last submitted has finished on the GPU.
+        m_culler.collect(frame_index);
+        double gpu_ms = m_profiler.collect(frame_index);
+        m_window_gpu_ms += gpu_ms;
+        ++m_window_gpu_samples;
+        m_run_gpu_ms += gpu_ms;
+        ++m_run_gpu_samples;
+    }
+
+    // A previous frame may still be rendering into this image.
+    if (m_images_in_flight[image_index] && m_images_in_flight[image_index] != frame.in_flight) {
+        if (m_device.waitForFences(m_images_in_flight[image_index], true, UINT64_MAX) != vk::Result::eSuccess)
+            throw std::runtime_error("Failed to wait for image fence");
+    }
+    m_images_in_flight[image_index] = frame.in_flight;
+
+    m_device.resetFences(frame.in_flight);
+    m_device.resetCommandPool(frame.command_pool);
+    m_uploads.flush();
+    auto record_start = Clock::now();
+    {
+        auto scope = m_profiler.cpu_scope("record");
+        record_command_buffer(frame, frame_index, image_index);
+    }
+    double record_ms = std::chrono::duration<double, std::milli>(Clock::now() - record_start).count();
+
+    // Binary acquire semaphore plus, while an upload batch is still in flight, the upload timeline.
+    std::array<vk::Semaphore, 2> wait_semaphores;
+    std::array<vk::PipelineStageFlags, 2> wait_stages;
+    std::array<uint64_t, 2> wait_values;
+    uint32_t wait_count = 0;
+    if (m_swapchain) {
+        wait_semaphores[wait_count] = frame.image_available;
+        wait_stages[wait_count] = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        wait_values[wait_count++] = 0;
+    }
+    if (frame.upload_wait_value) {
+        wait_semaphores[wait_count] = m_uploads.timeline();
+        wait_stages[wait_count] = upload_consumer_stages;
+        wait_values[wait_count++] = frame.upload_wait_value;
+    }
+
+    // The frame timeline reaches m_frame_number + 1 once this frame is done on the GPU.
+    std::array<vk::Semaphore, 2> signal_semaphores = { m_frame_timeline };
+    std::array<uint64_t, 2> signal_values = { m_frame_number + 1 };
+    uint32_t signal_count = 1;
+    if (m_swapchain) {
+        signal_semaphores[signal_count] = m_render_finished[image_index];
+        signal_values[signal_count++] = 0;
+    }
+
+    vk::TimelineSemaphoreSubmitInfo timeline_submit_info {
+        .waitSemaphoreValueCount = wait_count,
+        .pWaitSemaphoreValues = wait_values.data(),
+        .signalSemaphoreValueCount = signal_count,
+        .pSignalSemaphoreValues = signal_values.data()
+    };
+    vk::SubmitInfo submit_info {
+        .pNext = &timeline_submit_info,
+        .waitSemaphoreCount = wait_count,
+        .pWaitSemaphores = wait_semaphores.data(),
+        .pWaitDstStageMask = wait_stages.data(),
+        .commandBufferCount = 1,
+        .pCommandBuffers = &frame.command_buffer,
+        .signalSemaphoreCount = signal_count,
+        .pSignalSemaphores = signal_semaphores.data()
+    };
+    {
+        auto scope = m_profiler.cpu_scope("submit");
+        m_queue.submit(submit_info, frame.in_flight);
+    }
+    frame.submitted = true;
+    m_readback.submitted(m_frame_number, TimelinePoint { m_frame_timeline, m_frame_number + 1 });
+
+    uint64_t latency_id = ++m_present_id;
+    if (m_swapchain) {
+        auto scope = m_profiler.cpu_scope("present");
+        vk::PresentIdKHR present_id_info {
+            .swapchainCount = 1,
+            .pPresentIds = &latency_id
+        };
+        vk::PresentInfoKHR present_info {
+            .pNext = m_present_wait ? &present_id_info : nullptr,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &m_render_finished[image_index],
+            .swapchainCount = 1,
+            .pSwapchains = &m_swapchain,
+            .pImageIndices = &image_index
+        };
+        try {
+            if (m_present_queue.presentKHR(present_info) == vk::Result::eSuboptimalKHR)
+                m_swapchain_dirty = true;
+        } catch (const vk::OutOfDateKHRError&) {
+            m_swapchain_dirty = true;
+        }
+    }
+    m_latency.frame_started(latency_id, m_swapchain ? vk::to_string(m_present_mode) : "Offscreen", m_input_time);
+    frame.latency_id = m_present_wait && m_swapchain ? 0 : latency_id;
+
+    ++m_frame_number;
+    auto frame_end = Clock::now();
+    m_profiler.add_frame_time(std::chrono::duration<double, std::milli>(frame_end - frame_start).count());
+    update_stats(std::chrono::duration<double, std::milli>(frame_end - cpu_start).count(), record_ms);
+}
+
+void Application::record_command_buffer(FrameContext& frame, uint32_t frame_index, uint32_t image_index) {
+    vk::CommandBuffer cmd = frame.command_buffer;
+    cmd.begin(vk::CommandBufferBeginInfo { .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    frame.upload_wait_value = m_uploads.record_acquires(cmd);
+
+    m_profiler.begin_frame(cmd, frame_index);
+
+    if (m_dynamic_rendering) {
+        m_graph_frame_index = frame_index;
+        m_graph_image_index = image_index;
+        m_frame_graph.set_image(m_graph_target, m_images[image_index], m_image_views[image_index]);
+        m_frame_graph.execute(cmd);
+    } else {
+        record_cull_pass(cmd, frame_index);
+        record_main_pass(cmd, frame_index, image_index);
+        record_readback(cmd, image_index, m_surface ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eTransferSrcOptimal);
+    }
+
+    m_profiler.end_frame(cmd);
+
+    cmd.end();
+}
+
+void Application::record_cull_pass(const vk::CommandBuffer& cmd, uint32_t frame_index) {
+    if (!m_culler.enabled()) return;
+
+    auto scope = m_profiler.gpu_scope(cmd, "cull");
+    m_culler.record(cmd, frame_index, m_cull_frustum);
+}
+
+void Application::record_readback(const vk::CommandBuffer& cmd, uint32_t image_index, vk::ImageLayout layout) {
+    if (!m_readback.enabled()) return;
+
+    auto scope = m_profiler.gpu_scope(cmd, "readback");
+    m_readback.record(cmd, m_images[image_index], layout, m_extent, m_format, m_frame_number);
+}
+
+void Application::record_main_pass(const vk::CommandBuffer& cmd, uint32_t frame_index, uint32_t image_index) {
+    // The culled batch is a single indirect-count draw, so there is nothing to split.
+    uint32_t draw_count = m_culler.enabled() ? 1 : m_geometry.draw_count();
+    bool use_secondaries = m_record_scheduler != nullptr;
+    begin_rendering(cmd, image_index, use_secondaries);
+
+    if (use_secondaries) {
+        vk::CommandBufferInheritanceRenderingInfo rendering_inheritance {
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &m_format,
+            .rasterizationSamples = vk::SampleCountFlagBits::e1
+        };
+        vk::CommandBufferInheritanceInfo inheritance {
+            .pNext = m_dynamic_rendering ? &rendering_inheritance : nullptr,
+            .renderPass = m_render_pass,
+            .subpass = 0,
+            .framebuffer = m_dynamic_rendering ? vk::Framebuffer{} : m_framebuffers[image_index]
+        };
+        const auto& secondaries = m_recorder.record(frame_index, inheritance, draw_count,
+            [this](const vk::CommandBuffer& secondary, uint32_t first_draw, uint32_t draw_count) {
+                record_draws(secondary, first_draw, draw_count);
+            });
+        cmd.executeCommands(secondaries);
+    } else {
+        record_draws(cmd, 0, draw_count);
+    }
+    end_rendering(cmd);
+}
+
+// With dynamic rendering the frame graph does the layout transitions the render pass would.
+void Application::begin_rendering(const vk::CommandBuffer& cmd, uint32_t image_index, bool secondaries) {
+    vk::ClearValue clear_value;
+    clear_value.setColor(vk::ClearColorValue{}.setFloat32({ 0.0f, 0.0f, 0.0f, 1.0f }));
+    vk::Rect2D render_area { .offset = { 0, 0 }, .extent = m_extent };
+
+    if (!m_dynamic_rendering) {
+        vk::RenderPassBeginInfo render_pass_begin_info {
+            .renderPass = m_render_pass,
+            .framebuffer = m_framebuffers[image_index],
+            .renderArea = render_area,
+            .clearValueCount = 1,
+            .pClearValues = &clear_value
+        };
+        cmd.beginRenderPass(render_pass_begin_info, 
+                            secondaries ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+        return;
+    }
+
+    vk::RenderingAttachmentInfo color_attachment {
+        .imageView = m_image_views[image_index],
+        .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+        .loadOp = vk::AttachmentLoadOp::eClear,
+        .storeOp = vk::AttachmentStoreOp::eStore,
+        .clearValue = clear_value
+    };
+    cmd.beginRendering(vk::RenderingInfo {
+        .flags = secondaries ? vk::RenderingFlagBits::eContentsSecondaryCommandBuffers : vk::RenderingFlags{},
+        .renderArea = render_area,
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &color_attachment
+    });
+}
+
+void Application::end_rendering(const vk::CommandBuffer& cmd) {
+    if (m_dynamic_rendering)
+        cmd.endRendering();
+    else
+        cmd.endRenderPass();
+}
+
+// Secondary command buffers inherit no state, so every slice binds and sets everything itself.
+void Application::record_draws(const vk::CommandBuffer& cmd, uint32_t first_draw, uint32_t draw_count) {
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline(m_scene_variant));
+    if (m_dynamic_rendering)
+        set_default_dynamic_state(cmd);
+
+    vk::Viewport viewport {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(m_extent.width),
+        .height = static_cast<float>(m_extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    cmd.setViewport(0, viewport);
+    cmd.setScissor(0, vk::Rect2D { .offset = { 0, 0 }, .extent = m_extent });
+    m_bindless.bind(cmd, vk::PipelineBindPoint::eGraphics);
+    m_geometry.bind(cmd);
+    if (m_culler.enabled())
+        m_culler.draw(cmd);
+    else
+        m_geometry.draw(cmd, first_draw, draw_count);
+}
+
+// Present wait reports when the image actually reached the display; without it the frame's
+// fence (GPU completion) is the closest observable point.
+void Application::poll_latency() {
+    auto now = Clock::now();
+    if (m_present_wait && m_swapchain) {
+        while (m_latency.has_pending() 
+               && vkWaitForPresentKHR(m_device, m_swapchain, m_latency.oldest_pending(), 0) == VK_SUCCESS)
+            m_latency.frame_completed(m_latency.oldest_pending(), now);
+        return;
+    }
+
+    // Frame slots are not in submission order, so complete the finished ones oldest first.
+    std::vector<uint64_t> completed;
+    for (auto& frame : m_frames) {
+        if (frame.latency_id && m_device.getFenceStatus(frame.in_flight) == vk::Result::eSuccess) {
+            completed.push_back(frame.latency_id);
+            frame.latency_id = 0;
+        }
+    }
+    std::sort(completed.begin(), completed.end());
+    for (uint64_t id : completed)
+        m_latency.frame_completed(id, now);
+}
+
+void Application::update_stats(double cpu_ms, double record_ms) {
+    ++m_window_frames;
+    m_window_cpu_ms += cpu_ms;
+    m_window_record_ms += record_ms;
+    m_run_cpu_ms += cpu_ms;
+    m_run_record_ms += record_ms;
+
+    auto now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - m_window_start).count();
+    if (seconds < 1.0) return;
+
+    m_stats = FrameStats {
+        .frames = m_frame_number,
+        .fps = m_window_frames / seconds,
+        .cpu_ms = m_window_cpu_ms / m_window_frames,
+        .record_ms = m_window_record_ms / m_window_frames,
+        .gpu_ms = m_window_gpu_samples ? m_window_gpu_ms / m_window_gpu_samples : 0.0
+    };
+    std::cout << "fps: " << m_stats.fps 
+              << " cpu: " << m_stats.cpu_ms << " ms"
+              << " record: " << m_stats.record_ms << " ms"
+              << " gpu: " << m_stats.gpu_ms << " ms";
+    if (m_culler.enabled()) {
+        CullStats cull = m_culler.stats();
+        std::cout << " drawn: " << cull.drawn << "/" << cull.tested;
+    }
+    std::cout << "\n";
+
+    m_window_start = now;
+    m_window_frames = 0;
+    m_window_cpu_ms = 0.0;
+    m_window_record_ms = 0.0;
+    m_window_gpu_ms = 0.0;
+    m_window_gpu_samples = 0;
+}
+
 void Application::cleanup() {
     if (enable_validation_layers) 
         m_inst.destroyDebugUtilsMessengerEXT(m_db_messenger);
 
+    m_shader_reloader.stop();
+    swap_reloaded_pipelines();
+    m_tasks.destroy();
+    m_recorder.destroy();
+    for (const auto& frame : m_frames) {
+        m_device.destroySemaphore(frame.image_available);
+        m_device.destroyFence(frame.in_flight);
+        m_device.destroyCommandPool(frame.command_pool);
+    }
+    for (const auto& semaphore : m_render_finished)
+        m_device.destroySemaphore(semaphore);
+    m_device.destroySemaphore(m_frame_timeline);
+    m_profiler.destroy();
+    if (!m_config.trace_path.empty() && !m_profiler.write_chrome_trace(m_config.trace_path))
+        std::cerr << "Can't write trace " << m_config.trace_path << "\n";
+    m_deletion_queue.destroy();
+    for (const auto& framebuffer : m_framebuffers)
+        m_device.destroyFramebuffer(framebuffer);
     for (const auto& image_view : m_image_views)
         m_device.destroyImageView(image_view);
-    m_device.destroyPipeline(m_pipeline);
-    m_device.destroyPipelineLayout(m_pipeline_layout);
+    m_pipeline_cache.save();
+    m_pipeline_cache.destroy();
+    for (const auto& [key, pipeline] : m_pipeline_lookup)
+        m_device.destroyPipeline(pipeline);
     m_device.destroyRenderPass(m_render_pass);
-    m_device.destroySwapchainKHR(m_swapchain);
+    if (m_swapchain) {
+        m_device.destroySwapchainKHR(m_swapchain);
+    }
+    m_uploads.destroy();
+    m_geometry.destroy(m_allocator);
+    m_readback.destroy();
+    m_frame_graph.destroy(m_allocator);
+    m_culler.destroy(m_allocator);
+    m_bindless.destroy();
+    for (const auto& image : m_offscreen_images)
+        m_allocator.destroy_image(image);
+    m_memory_budget.destroy();
+    m_allocator.destroy();
     m_device.destroy();
-    m_inst.destroySurfaceKHR(m_surface);
+    if (m_surface)
+        m_inst.destroySurfaceKHR(m_surface);
     m_inst.destroy();
 
-    glfwDestroyWindow(m_window);
-    glfwTerminate();
+    DebugMessageCounts messages = debug_message_counts();
+    if (messages.severity[2] + messages.severity[3] > 0)
+        std::cerr << "Validation: " << messages.severity[3] << " errors, " << messages.severity[2] << " warnings ("
+                  << messages.type[2] << " performance), " << messages.suppressed << " suppressed, "
+                  << messages.dropped << " dropped\n";
+
+    if (m_window) {
+        glfwDestroyWindow(m_window);
+        glfwTerminate();
+    }
 }
 
 void Application::init_vulkan() {
-    create_instance();
-    setup_debugger();
-    create_surface();
-    select_physical_device();
-    create_device();
-    create_swapchain();
-    create_image_view();
-    create_render_pass();
-    create_pipeline();
+    m_init_stage_times.clear();
+    auto run_stage = [this](const char* name, void (Application::*create)()) {
+        auto scope = m_profiler.cpu_scope(name);
+        auto start = Clock::now();
+        (this->*create)();
+        return InitStageTime {
+            .name = name,
+            .ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count()
+        };
+    };
+    auto stage = [&](const char* name, void (Application::*create)()) {
+        m_init_stage_times.push_back(run_stage(name, create));
+    };
+    // Runs two independent stages at once. The first stays on this thread, because GLFW only
+    // creates windows on the main thread; the second runs on a worker.
+    auto stage_pair = [&](const char* name, void (Application::*create)(),
+                          const char* worker_name, void (Application::*worker_create)()) {
+        auto worker = std::async(std::launch::async, run_stage, worker_name, worker_create);
+        InitStageTime time = run_stage(name, create);
+        m_init_stage_times.push_back(worker.get());
+        m_init_stage_times.push_back(time);
+    };
+
+    stage_pair("create_window", &Application::create_window, "create_instance", &Application::create_instance);
+    stage("setup_debugger", &Application::setup_debugger);
+    stage("create_surface", &Application::create_surface);
+    stage("select_physical_device", &Application::select_physical_device);
+    stage_pair("create_device", &Application::create_device, "load_shaders", &Application::load_shaders);
+    stage("create_swapchain", &Application::create_swapchain);
+    stage("create_image_view", &Application::create_image_view);
+    stage("create_render_pass", &Application::create_render_pass);
+    stage("create_descriptors", &Application::create_descriptors);
+    stage("create_pipeline_cache", &Application::create_pipeline_cache);
+    stage("create_pipeline", &Application::create_pipeline);
+    stage("create_framebuffers", &Application::create_framebuffers);
+    stage("create_frames", &Application::create_frames);
+    stage("create_geometry", &Application::create_geometry);
+    stage("create_frame_graph", &Application::create_frame_graph);
+    stage("start_shader_reload", &Application::start_shader_reload);
 }
 
 void Application::setup_debugger() {
@@ -72,7 +636,7 @@ void Application::setup_debugger() {
         VkToolMakeDebugUtilsMessengerEXT(m_inst);
         
     vk::DebugUtilsMessengerCreateInfoEXT messenger_info
-        = get_messenger_create_info();
+        = get_messenger_create_info(m_debug_sink.get());
 
     m_db_messenger = m_inst.createDebugUtilsMessengerEXT(messenger_info);
 }
@@ -89,7 +653,7 @@ void Application::create_instance() {
         .apiVersion = VK_API_VERSION_1_3
     };
 
-    std::vector<const char*> extensions = get_required_extensions();
+    std::vector<const char*> extensions = get_required_extensions(m_config.headless, m_config.use_headless_surface);
     vk::InstanceCreateInfo info {
         .pApplicationInfo = &appinfo,
         .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
@@ -98,7 +662,9 @@ void Application::create_instance() {
                                         
     vk::DebugUtilsMessengerCreateInfoEXT messenger_info;
     if (enable_validation_layers) {
-        messenger_info = get_messenger_create_info();
+        m_debug_sink = std::make_unique<DebugMessageSink>(std::cerr, DebugMessageSink::default_max_per_second,
+            static_cast<VkDebugUtilsMessageSeverityFlagBitsEXT>(m_config.validation_min_printed));
+        messenger_info = get_messenger_create_info(m_debug_sink.get());
         info.setEnabledLayerCount(static_cast<uint32_t>(validation_layers.size()))
             .setPpEnabledLayerNames(validation_layers.data())
             .setPNext(&messenger_info);
@@ -112,23 +678,47 @@ void Application::create_instance() {
 
 void Application::select_physical_device() {
     auto available_devices = m_inst.enumeratePhysicalDevices();
-    
-    for (const auto& device : available_devices) {
-        if (is_device_suitable(device, m_surface)) {
-            m_phy_device = device;
-            break;
+
+    // An explicit index or name wins over the score, as long as the device can actually run us.
+    // Each device is queried once here; the winner's snapshot serves the rest of startup.
+    bool found = false;
+    uint64_t best_score = 0;
+    for (size_t i = 0; i < available_devices.size(); ++i) {
+        if (m_config.device_index >= 0 && static_cast<size_t>(m_config.device_index) != i)
+            continue;
+
+        DeviceCapabilities caps = DeviceCapabilities::query(available_devices[i], m_surface);
+        if (!m_config.device_name.empty() 
+            && std::string_view(caps.properties.deviceName.data()).find(m_config.device_name) == std::string_view::npos)
+            continue;
+        if (!is_device_suitable(caps, m_surface))
+            continue;
+
+        uint64_t score = rate_device(caps);
+        if (!found || score > best_score) {
+            m_caps = std::move(caps);
+            best_score = score;
+            found = true;
         }
     }
 
-    if (!m_phy_device)
+    if (!found)
         throw std::runtime_error("Can't find a suitable GPU");
+
+    m_phy_device = m_caps.device;
+    std::cout << "Selected " << m_caps.properties.deviceName.data() 
+              << " (score " << best_score << ")\n";
 }
 
 void Application::create_device() {
-    QueueFamilyIndices indices = QueueFamilyIndices::find_queue_families(m_phy_device, m_surface);
+    const QueueFamilyIndices& indices = m_caps.queue_families;
 
     std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
     std::set<uint32_t> unique_queue_families = { indices.graphics.value(), indices.present.value() };
+    if (indices.compute)
+        unique_queue_families.insert(indices.compute.value());
+    if (indices.transfer)
+        unique_queue_families.insert(indices.transfer.value());
 
     float priority = 1.0f;
     for (auto queue_family : unique_queue_families) {
@@ -141,12 +731,68 @@ void Application::create_device() {
         queue_create_infos.emplace_back(std::move(queue_create_info));
     }
 
-    vk::PhysicalDeviceFeatures phy_device_features{};
+    // Offscreen rendering never presents, so the swapchain extension is only needed with a surface.
+    std::vector<const char*> extensions;
+    if (m_surface)
+        extensions = device_extensions;
+    m_present_wait = m_surface && m_caps.present_wait;
+    if (m_present_wait) {
+        extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+    if (m_caps.memory_budget)
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    vk::PhysicalDevicePresentWaitFeaturesKHR present_wait_features {
+        .presentWait = static_cast<vk::Bool32>(true)
+    };
+    vk::PhysicalDevicePresentIdFeaturesKHR present_id_features {
+        .pNext = &present_wait_features,
+        .presentId = static_cast<vk::Bool32>(true)
+    };
+
+    // The frame graph behind the dynamic rendering path records synchronization2 barriers.
+    m_dynamic_rendering = m_config.dynamic_rendering && m_caps.vulkan13_features.dynamicRendering
+                       && m_caps.vulkan13_features.synchronization2;
+    if (m_config.dynamic_rendering && !m_dynamic_rendering)
+        std::cerr << "Dynamic rendering is unsupported, using a render pass\n";
+
+    // Extended dynamic state is core in 1.3 and needs no feature bit of its own.
+    vk::PhysicalDeviceVulkan13Features vulkan13_features {
+        .pNext = m_present_wait ? &present_id_features : nullptr,
+        .synchronization2 = static_cast<vk::Bool32>(m_dynamic_rendering),
+        .dynamicRendering = static_cast<vk::Bool32>(m_dynamic_rendering)
+    };
+    bool vulkan13 = m_caps.properties.apiVersion >= VK_API_VERSION_1_3;
+    vk::Bool32 bindless = BindlessDescriptors::supported(m_caps);
+
+    vk::PhysicalDeviceVulkan12Features vulkan12_features {
+        .pNext = vulkan13 ? static_cast<void*>(&vulkan13_features) 
+                          : m_present_wait ? static_cast<void*>(&present_id_features) : nullptr,
+        .drawIndirectCount = m_caps.vulkan12_features.drawIndirectCount,
+        .shaderSampledImageArrayNonUniformIndexing = bindless && m_caps.vulkan12_features.shaderSampledImageArrayNonUniformIndexing,
+        .shaderStorageBufferArrayNonUniformIndexing = bindless && m_caps.vulkan12_features.shaderStorageBufferArrayNonUniformIndexing,
+        .descriptorBindingSampledImageUpdateAfterBind = bindless,
+        .descriptorBindingStorageBufferUpdateAfterBind = bindless,
+        .descriptorBindingUpdateUnusedWhilePending = bindless,
+        .descriptorBindingPartiallyBound = bindless,
+        .runtimeDescriptorArray = bindless,
+        .timelineSemaphore = m_caps.vulkan12_features.timelineSemaphore
+    };
+
+    vk::PhysicalDeviceFeatures phy_device_features {
+        .multiDrawIndirect = m_caps.features.multiDrawIndirect,
+        .drawIndirectFirstInstance = m_caps.features.drawIndirectFirstInstance,
+        .pipelineStatisticsQuery = m_caps.features.pipelineStatisticsQuery,
+        .shaderSampledImageArrayDynamicIndexing = bindless,
+        .shaderStorageBufferArrayDynamicIndexing = bindless
+    };
     vk::DeviceCreateInfo device_create_info {
+        .pNext = &vulkan12_features,
         .queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size()),
         .pQueueCreateInfos = queue_create_infos.data(),
-        .enabledExtensionCount = static_cast<uint32_t>(device_extensions.size()),
-        .ppEnabledExtensionNames = device_extensions.data(),
+        .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+        .ppEnabledExtensionNames = extensions.data(),
         .pEnabledFeatures = &phy_device_features
     };
     
@@ -158,29 +804,84 @@ void Application::create_device() {
     }
 
     m_device = m_phy_device.createDevice(device_create_info);
+    if (m_present_wait)
+        VkToolMakePresentWaitKHR(m_device);
+    m_graphics_family = indices.graphics.value();
     m_queue = m_device.getQueue(indices.graphics.value(), 0);
+    m_present_queue = m_device.getQueue(indices.present.value(), 0);
+
+    // Fall back to the graphics queue so callers never have to check for a missing family.
+    m_compute_family = indices.compute.value_or(m_graphics_family);
+    m_transfer_family = indices.transfer.value_or(m_graphics_family);
+    m_compute_queue = m_device.getQueue(m_compute_family, 0);
+    m_transfer_queue = m_device.getQueue(m_transfer_family, 0);
+
+    m_allocator.init(m_device, m_caps);
+    m_memory_budget.init(m_phy_device, m_allocator, m_caps.memory_budget, m_config.memory_budget_limit);
+    // Only at frame boundaries: mid-allocation, the empty blocks are what the allocation would reuse.
+    m_memory_budget.add_eviction_handler("empty blocks", [this](const EvictionRequest& request) {
+        return request.allocating ? vk::DeviceSize{ 0 } : m_allocator.trim(request.heap);
+    });
+    if (!m_caps.memory_budget)
+        std::cout << "No VK_EXT_memory_budget, estimating memory budgets from heap sizes\n";
+    m_deletion_queue.init(m_device, m_allocator);
+    m_tasks.init(m_device, m_thread_pool);
+    m_uploads.init(m_device, m_caps, m_allocator, m_transfer_queue, m_transfer_family, m_graphics_family);
+
+    ReadbackConsumer consumer = m_config.readback_consumer;
+    if (!consumer && !m_config.readback_path.empty())
+        consumer = FrameFileWriter(m_config.readback_path, m_config.readback_format);
+    if (consumer) {
+        m_readback.init(m_device, m_caps.properties.limits, m_allocator, m_tasks,
+                        std::max(m_config.frames_in_flight, 1u), m_config.readback_latency, std::move(consumer));
+    }
 }
 
 void Application::create_surface() {
-    vk::Win32SurfaceCreateInfoKHR surface_create_info {
-        .hinstance = nullptr,
-        .hwnd = glfwGetWin32Window(m_window)
-    };
-    
-    m_surface = m_inst.createWin32SurfaceKHR(surface_create_info);
+    if (m_window) {
+        VkSurfaceKHR surface;
+        if (glfwCreateWindowSurface(m_inst, m_window, nullptr, &surface) != VK_SUCCESS)
+            throw std::runtime_error("Can't create window surface");
+        m_surface = surface;
+        return;
+    }
+
+    if (!m_config.use_headless_surface 
+        || !check_instance_extension_support(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME))
+        return;
+
+    VkToolMakeHeadlessSurfaceEXT(m_inst);
+    m_surface = m_inst.createHeadlessSurfaceEXT(vk::HeadlessSurfaceCreateInfoEXT{});
 }
 
 void Application::create_swapchain() {
-    SwapChainSupportDetails details = query_swapchain_support(m_phy_device, m_surface);
+    if (!m_surface) {
+        create_offscreen_images();
+        return;
+    }
+
+    const SwapChainSupportDetails& details = m_caps.swapchain_support;
 
     vk::SurfaceFormatKHR format = choose_surface_format(details.formats);
-    vk::PresentModeKHR present = choose_present_mode(details.present_modes);
-    vk::Extent2D extent = choose_extent(details.capabilities, m_window);
+    vk::PresentModeKHR present = choose_present_mode(details.present_modes, m_config.present_mode);
+    vk::Extent2D extent = choose_extent(details.capabilities, m_window, vk::Extent2D { m_config.width, m_config.height });
 
-    uint32_t image_count = details.capabilities.minImageCount + 1;
+    uint32_t image_count = m_config.swapchain_image_count 
+                         ? std::max(m_config.swapchain_image_count, details.capabilities.minImageCount) 
+                         : details.capabilities.minImageCount + 1;
 
     if (details.capabilities.maxImageCount > 0 && image_count > details.capabilities.maxImageCount) 
         image_count = details.capabilities.maxImageCount;
+
+    // Readback copies straight out of the swapchain images.
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+    if (m_readback.enabled()) {
+        if (!(details.capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc))
+            throw std::runtime_error("Swapchain images can't be a transfer source, readback is impossible");
+        if (!FrameReadback::supports(format.format))
+            throw std::runtime_error("Readback needs an 8-bit RGBA or BGRA swapchain, got " + vk::to_string(format.format));
+        usage |= vk::ImageUsageFlagBits::eTransferSrc;
+    }
     
     vk::SwapchainCreateInfoKHR swapchain_create_info {
         .surface = m_surface,
@@ -189,10 +890,10 @@ void Application::create_swapchain() {
         .imageColorSpace = format.colorSpace,
         .imageExtent = extent,
         .imageArrayLayers = 1,
-        .imageUsage = vk::ImageUsageFlagBits::eColorAttachment
+        .imageUsage = usage
     };
 
-    QueueFamilyIndices indices = QueueFamilyIndices::find_queue_families(m_phy_device, m_surface);
+    const QueueFamilyIndices& indices = m_caps.queue_families;
     uint32_t queue_family_indices[] = {
         indices.graphics.value(),
         indices.present.value()
@@ -214,13 +915,71 @@ void Application::create_swapchain() {
         .setPreTransform(details.capabilities.currentTransform)
         .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
         .setPresentMode(present)
-        .setClipped(static_cast<vk::Bool32>(true));
+        .setClipped(static_cast<vk::Bool32>(true))
+        .setOldSwapchain(m_swapchain);
 
     m_swapchain = m_device.createSwapchainKHR(swapchain_create_info);
     m_extent = extent;
     m_format = format.format;
+    m_present_mode = present;
 
     m_images = m_device.getSwapchainImagesKHR(m_swapchain);
+    std::cout << "Swapchain " << extent.width << "x" << extent.height << ", " << m_images.size() 
+              << " images, " << vk::to_string(present) << "\n";
+}
+
+// Runs between frames without waiting for the device: the old swapchain is handed to the new
+// one as oldSwapchain and retired together with its views and framebuffers. The surface format
+// never changes, so the render pass and pipelines stay valid.
+void Application::recreate_swapchain() {
+    m_swapchain_dirty = false;
+    m_caps.swapchain_support.capabilities = m_phy_device.getSurfaceCapabilitiesKHR(m_surface);
+
+    // Keyed on the frame about to be recorded rather than the last one that used them, which
+    // leaves presentation of the final old image a frame to complete.
+    for (const auto& framebuffer : m_framebuffers)
+        m_deletion_queue.retire(framebuffer, m_frame_number);
+    for (const auto& image_view : m_image_views)
+        m_deletion_queue.retire(image_view, m_frame_number);
+    m_image_views.clear();
+    m_framebuffers.clear();
+    vk::SwapchainKHR old_swapchain = m_swapchain;
+
+    create_swapchain();
+    snapshot_reload_target();
+    m_deletion_queue.retire(old_swapchain, m_frame_number);
+    create_image_view();
+    create_framebuffers();
+    for (const auto& semaphore : m_render_finished)
+        m_deletion_queue.retire(semaphore, m_frame_number);
+    create_present_semaphores();
+    m_images_in_flight.assign(m_images.size(), vk::Fence{});
+    m_latency.drop_pending();
+}
+
+void Application::create_offscreen_images() {
+    m_format = vk::Format::eR8G8B8A8Srgb;
+    m_extent = vk::Extent2D { m_config.width, m_config.height };
+
+    vk::ImageCreateInfo image_create_info {
+        .imageType = vk::ImageType::e2D,
+        .format = m_format,
+        .extent = vk::Extent3D { m_extent.width, m_extent.height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = vk::SampleCountFlagBits::e1,
+        .tiling = vk::ImageTiling::eOptimal,
+        .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+        .sharingMode = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    };
+
+    m_offscreen_images.resize(m_config.offscreen_image_count);
+    m_images.resize(m_config.offscreen_image_count);
+    for (size_t i = 0; i < m_images.size(); ++i) {
+        m_offscreen_images[i] = m_allocator.create_image(image_create_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        m_images[i] = m_offscreen_images[i].image;
+    }
 }
 
 void Application::create_image_view() {
@@ -249,6 +1008,8 @@ void Application::create_image_view() {
 }
 
 void Application::create_render_pass() {
+    if (m_dynamic_rendering) return;
+
     vk::AttachmentDescription color_attachment {
         .format = m_format,
         .samples = vk::SampleCountFlagBits::e1,
@@ -257,7 +1018,7 @@ void Application::create_render_pass() {
         .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
         .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
         .initialLayout = vk::ImageLayout::eUndefined,
-        .finalLayout = vk::ImageLayout::ePresentSrcKHR
+        .finalLayout = m_surface ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eTransferSrcOptimal
     
     };
 
@@ -272,118 +1033,404 @@ void Application::create_render_pass() {
         .pColorAttachments = &color_attach_ref
     };
 
+    // Keeps the layout transition from running before the acquire semaphore is signaled.
+    // The second orders the readback copy after the color writes and the final layout transition.
+    vk::SubpassDependency dependencies[] = {
+        vk::SubpassDependency {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .srcAccessMask = vk::AccessFlags{},
+            .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite
+        },
+        vk::SubpassDependency {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .dstStageMask = vk::PipelineStageFlagBits::eTransfer,
+            .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eTransferRead
+        }
+    };
+
     vk::RenderPassCreateInfo render_pass_create_info {
         .attachmentCount = 1,
         .pAttachments = &color_attachment,
         .subpassCount = 1,
-        .pSubpasses = &subpass
+        .pSubpasses = &subpass,
+        .dependencyCount = 2,
+        .pDependencies = dependencies
     };
 
     m_render_pass = m_device.createRenderPass(render_pass_create_info);
 }
 
+// Everything startup reads from disk, none of which needs the device.
+void Application::load_shaders() {
+    m_vert_shader = shader_vert_spv;
+    m_frag_shader = shader_frag_spv;
+    if (!m_config.shader_pack_path.empty()) {
+        m_shader_pack = std::make_unique<ShaderPack>(m_config.shader_pack_path);
+        m_vert_shader = m_shader_pack->get("shader.vert");
+        m_frag_shader = m_shader_pack->get("shader.frag");
+    }
+
+    m_pipeline_cache.load(m_config.pipeline_cache_path);
+}
+
+void Application::create_pipeline_cache() {
+    m_pipeline_cache.create(m_device, m_caps.properties);
+}
+
+void Application::create_descriptors() {
+    m_bindless.init(m_device, m_caps);
+}
+
 void Application::create_pipeline() {
-    std::vector<char> vert_shader = read_file("E:/code-cpp/TestVulkan/shader/binary/vert.spv");
-    std::vector<char> frag_shader = read_file("E:/code-cpp/TestVulkan/shader/binary/frag.spv");
-    vk::ShaderModule vs = create_shader_module(m_device, vert_shader);
-    vk::ShaderModule fs = create_shader_module(m_device, frag_shader);
-
-    vk::PipelineShaderStageCreateInfo stages[] = {
-        vk::PipelineShaderStageCreateInfo {
-            .stage = vk::ShaderStageFlagBits::eVertex,
-            .module = vs,
-            .pName = "main"
-        },
-        vk::PipelineShaderStageCreateInfo {
-            .stage = vk::ShaderStageFlagBits::eFragment,
-            .module = fs,
-            .pName = "main"
+    PipelineShaders shaders = create_scene_shaders(m_vert_shader, m_frag_shader);
+    std::vector<PipelineVariant> variants = pipeline_variants();
+    PipelineBuilder builder(m_device, m_pipeline_cache.handle(), m_thread_pool);
+    std::vector<PipelineBuildResult> results = builder.build(shaders, m_bindless.layout(), m_render_pass, m_format, variants);
+    m_pipeline_cache.add_compile_time(builder.wall_time());
+
+    using ms = std::chrono::duration<double, std::milli>;
+    if (results.size() > 1) {
+        for (const auto& result : results) {
+            auto variant = std::find_if(variants.begin(), variants.end(), [&](const PipelineVariant& candidate) {
+                return candidate.key(shaders.hash, m_render_pass, m_format) == result.key;
+            });
+            std::cout << "  " << variant->describe() << ": " << ms(result.compile_time).count() << " ms\n";
         }
-    };
+        std::cout << results.size() << " pipeline variants on " << m_thread_pool.size() << " threads";
+        if (builder.duplicates() > 0)
+            std::cout << ", " << builder.duplicates() << " duplicates skipped";
+        std::cout << "\n";
+    }
+    if (m_config.gpu_culling && m_bindless.enabled()) {
+        const vk::PhysicalDeviceLimits& limits = m_caps.properties.limits;
+        uint32_t group_size = m_config.cull_group_size;
+        if (group_size == 0 || group_size > limits.maxComputeWorkGroupSize[0]
+            || group_size > limits.maxComputeWorkGroupInvocations)
+            throw std::runtime_error("Cull workgroup size " + std::to_string(group_size) + " is not supported");
+        m_culler.create_pipeline(m_device, m_pipeline_cache.handle(), m_bindless, group_size);
+    }
+    m_pipeline_cache.report();
 
-    vk::PipelineVertexInputStateCreateInfo vertex_input_create_info {
-        .vertexBindingDescriptionCount = 0,
-        .vertexAttributeDescriptionCount = 0
+    install_pipelines(results, shaders.hash, variants.front());
+    snapshot_reload_target();
+    m_device.destroyShaderModule(shaders.vertex);
+    m_device.destroyShaderModule(shaders.fragment);
+}
+
+PipelineShaders Application::create_scene_shaders(std::span<const uint32_t> vertex, std::span<const uint32_t> fragment) const {
+    return PipelineShaders {
+        .vertex = create_shader_module(m_device, vertex),
+        .fragment = create_shader_module(m_device, fragment),
+        .vertex_format = scene_vertex_format(),
+        .hash = PipelineHash{}.add(shader_hash(vertex)).add(shader_hash(fragment)).value()
     };
+}
+
+void Application::install_pipelines(const std::vector<PipelineBuildResult>& results, uint64_t shaders_hash,
+                                    const PipelineVariant& scene_variant) {
+    m_shaders_hash = shaders_hash;
+    m_scene_variant = scene_variant;
+    m_pipeline_lookup.clear();
+    for (const auto& result : results)
+        m_pipeline_lookup.emplace(result.key, result.pipeline);
+    if (!pipeline(m_scene_variant))
+        throw std::runtime_error("The scene pipeline variant was not built");
+}
+
+vk::Pipeline Application::pipeline(const PipelineVariant& variant) const {
+    auto it = m_pipeline_lookup.find(variant.key(m_shaders_hash, m_render_pass, m_format));
+    return it != m_pipeline_lookup.end() ? it->second : nullptr;
+}
+
+// The default variant always comes first, so it doubles as the pipeline the frame loop draws with.
+// With dynamic rendering a handful of dynamic-state pipelines replace the baked permutations.
+std::vector<PipelineVariant> Application::pipeline_variants() const {
+    if (m_dynamic_rendering) {
+        std::vector<PipelineVariant> variants = PipelineVariant::dynamic_permutations(m_format);
+        if (!m_config.compile_pipeline_permutations)
+            variants.resize(1);
+        return variants;
+    }
+    return m_config.compile_pipeline_permutations 
+        ? PipelineVariant::permutations() 
+        : std::vector<PipelineVariant>{ PipelineVariant{} };
+}
+
+void Application::start_shader_reload() {
+    if (!m_config.hot_reload) return;
+
+    std::string source_dir = m_config.shader_source_dir.empty() ? SHADER_SOURCE_DIR : m_config.shader_source_dir;
+    std::string compiler = m_config.shader_compiler.empty() ? GLSLC_EXECUTABLE : m_config.shader_compiler;
+    m_reload_pool = std::make_unique<ThreadPool>(reload_threads);
+    m_shader_reloader.start(source_dir, compiler, [this](const ShaderChanges& changed) {
+        rebuild_pipelines(changed);
+    });
+    std::cout << "Watching " << source_dir << " for shader changes\n";
+}
 
-    vk::PipelineInputAssemblyStateCreateInfo input_assembly_create_info {
-        .topology = vk::PrimitiveTopology::eTriangleList,
-        .primitiveRestartEnable = static_cast<vk::Bool32>(false)
+void Application::snapshot_reload_target() {
+    if (!m_config.hot_reload) return;
+
+    std::lock_guard lock(m_reload_target_mutex);
+    m_reload_target = ReloadTarget {
+        .variants = pipeline_variants(),
+        .render_pass = m_render_pass,
+        .format = m_format
     };
+}
 
-    vk::PipelineViewportStateCreateInfo viewport_create_info {
-        .viewportCount = 1,
-        .scissorCount = 1
+// Runs on the reloader's thread while frames keep rendering with the current pipelines. Only
+// the pipelines built from a changed shader are rebuilt, through the same pipeline cache.
+void Application::rebuild_pipelines(const ShaderChanges& changed) {
+    for (const auto& [name, code] : changed)
+        m_reloaded_spirv[name] = code;
+    auto spirv = [this](const std::string& name, std::span<const uint32_t> current) {
+        auto it = m_reloaded_spirv.find(name);
+        return it != m_reloaded_spirv.end() ? std::span<const uint32_t>(it->second) : current;
     };
 
-    vk::PipelineRasterizationStateCreateInfo rasterization_create_info {
-        .depthClampEnable = static_cast<vk::Bool32>(false),
-        .rasterizerDiscardEnable = static_cast<vk::Bool32>(false),
-        .polygonMode = vk::PolygonMode::eFill,
-        .cullMode = vk::CullModeFlagBits::eBack,
-        .frontFace = vk::FrontFace::eClockwise,
-        .depthBiasEnable = static_cast<vk::Bool32>(false),
-        .lineWidth = 1.0f
+    auto start = Clock::now();
+    auto reloaded = std::make_unique<ReloadedPipelines>();
+    try {
+        if (changed.contains("shader.vert") || changed.contains("shader.frag")) {
+            ReloadTarget target;
+            {
+                std::lock_guard lock(m_reload_target_mutex);
+                target = m_reload_target;
+            }
+            PipelineShaders shaders = create_scene_shaders(spirv("shader.vert", m_vert_shader), spirv("shader.frag", m_frag_shader));
+            PipelineBuilder builder(m_device, m_pipeline_cache.handle(), *m_reload_pool);
+            reloaded->graphics = builder.build(shaders, m_bindless.layout(), target.render_pass, target.format, target.variants);
+            reloaded->shaders_hash = shaders.hash;
+            reloaded->render_pass = target.render_pass;
+            reloaded->format = target.format;
+            reloaded->scene_variant = target.variants.front();
+            m_device.destroyShaderModule(shaders.vertex);
+            m_device.destroyShaderModule(shaders.fragment);
+        }
+        if (changed.contains("cull.comp") && m_config.gpu_culling && m_bindless.enabled())
+            reloaded->cull = m_culler.build_pipeline(m_pipeline_cache.handle(), m_bindless, m_reloaded_spirv["cull.comp"]);
+    } catch (const std::exception& e) {
+        std::cerr << "Pipeline rebuild failed, keeping the current pipelines: " << e.what() << "\n";
+        for (const auto& result : reloaded->graphics)
+            m_device.destroyPipeline(result.pipeline);
+        return;
+    }
+    if (reloaded->graphics.empty() && !reloaded->cull) return;
+
+    std::cout << "Reloaded " << reloaded->graphics.size() + (reloaded->cull ? 1 : 0) << " pipelines in "
+              << std::chrono::duration<double, std::milli>(Clock::now() - start).count() << " ms\n";
+
+    // A set the render thread has not picked up yet was never used. Only this thread publishes,
+    // so it can be taken back and merged, keeping whichever half is newer.
+    std::unique_ptr<ReloadedPipelines> pending(m_reloaded_pipelines.exchange(nullptr, std::memory_order_acquire));
+    if (pending) {
+        if (reloaded->graphics.empty()) {
+            std::swap(reloaded->graphics, pending->graphics);
+            reloaded->shaders_hash = pending->shaders_hash;
+            reloaded->render_pass = pending->render_pass;
+            reloaded->format = pending->format;
+            reloaded->scene_variant = pending->scene_variant;
+        }
+        if (!reloaded->cull)
+            std::swap(reloaded->cull, pending->cull);
+        for (const auto& result : pending->graphics)
+            m_device.destroyPipeline(result.pipeline);
+        m_device.destroyPipeline(pending->cull);
+    }
+    m_reloaded_pipelines.store(reloaded.release(), std::memory_order_release);
+}
+
+// Called between frames: the frame about to be recorded is the first to use the new pipelines,
+// and the old ones wait in the deletion queue until the frames still in flight have finished.
+void Application::swap_reloaded_pipelines() {
+    std::unique_ptr<ReloadedPipelines> reloaded(m_reloaded_pipelines.exchange(nullptr, std::memory_order_acquire));
+    if (!reloaded) return;
+
+    // Built against a target the swapchain has moved on from; never used, so destroyed right away.
+    if (!reloaded->graphics.empty() && (reloaded->render_pass != m_render_pass || reloaded->format != m_format)) {
+        std::cerr << "Dropping reloaded pipelines built for a previous swapchain\n";
+        for (const auto& result : reloaded->graphics)
+            m_device.destroyPipeline(result.pipeline);
+        reloaded->graphics.clear();
+    }
+    if (!reloaded->graphics.empty()) {
+        for (const auto& [key, pipeline] : m_pipeline_lookup)
+            retire(pipeline);
+        install_pipelines(reloaded->graphics, reloaded->shaders_hash, reloaded->scene_variant);
+    }
+    if (reloaded->cull)
+        retire(m_culler.replace_pipeline(reloaded->cull));
+}
+
+void Application::create_framebuffers() {
+    if (m_dynamic_rendering) return;
+
+    m_framebuffers.resize(m_image_views.size());
+    for (size_t i = 0; i < m_framebuffers.size(); ++i) {
+        vk::FramebufferCreateInfo framebuffer_create_info {
+            .renderPass = m_render_pass,
+            .attachmentCount = 1,
+            .pAttachments = &m_image_views[i],
+            .width = m_extent.width,
+            .height = m_extent.height,
+            .layers = 1
+        };
+        m_framebuffers[i] = m_device.createFramebuffer(framebuffer_create_info);
+    }
+}
+
+void Application::create_present_semaphores() {
+    m_render_finished.clear();
+    if (!m_swapchain) return;
+
+    for (size_t i = 0; i < m_images.size(); ++i)
+        m_render_finished.push_back(m_device.createSemaphore(vk::SemaphoreCreateInfo{}));
+}
+
+void Application::create_frames() {
+    m_frames.resize(std::max(m_config.frames_in_flight, 1u));
+    m_images_in_flight.assign(m_images.size(), vk::Fence{});
+
+    for (auto& frame : m_frames) {
+        frame.command_pool = m_device.createCommandPool(vk::CommandPoolCreateInfo {
+            .flags = vk::CommandPoolCreateFlagBits::eTransient,
+            .queueFamilyIndex = m_graphics_family
+        });
+
+        vk::CommandBufferAllocateInfo alloc_info {
+            .commandPool = frame.command_pool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1
+        };
+        frame.command_buffer = m_device.allocateCommandBuffers(alloc_info).front();
+        frame.image_available = m_device.createSemaphore(vk::SemaphoreCreateInfo{});
+        frame.in_flight = m_device.createFence(vk::FenceCreateInfo { .flags = vk::FenceCreateFlagBits::eSignaled });
+    }
+    create_present_semaphores();
+    vk::SemaphoreTypeCreateInfo timeline_info {
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue = 0
     };
+    m_frame_timeline = m_device.createSemaphore(vk::SemaphoreCreateInfo { .pNext = &timeline_info });
+
+    // Secondaries executed inside a statistics query would need inheritedQueries, so threaded
+    // recording goes without pipeline statistics.
+    bool pipeline_statistics = m_caps.features.pipelineStatisticsQuery && m_config.record_threads == 0;
+    m_profiler.init_gpu(m_device, m_caps, m_queue, m_graphics_family, 
+                        static_cast<uint32_t>(m_frames.size()), pipeline_statistics);
 
-    vk::PipelineMultisampleStateCreateInfo multisampling_create_info {
-        .rasterizationSamples = vk::SampleCountFlagBits::e1,
-        .sampleShadingEnable = static_cast<vk::Bool32>(false)
+    if (m_config.record_threads > 0) {
+        m_record_scheduler = std::make_unique<WorkStealingScheduler>(m_config.record_threads);
+        m_recorder.init(m_device, m_graphics_family, static_cast<uint32_t>(m_frames.size()), *m_record_scheduler);
+    }
+}
+
+// A triangle and a quad, instanced over a grid covering the viewport. Each indirect draw covers
+// an equal share of the instances and alternates between the two meshes.
+void Application::create_geometry() {
+    m_geometry.init(m_caps, scene_vertex_format());
+
+    const SceneVertex triangle_vertices[] = {
+        { {  0.0f, -0.5f }, { 255, 0, 0, 255 } },
+        { {  0.5f,  0.5f }, { 0, 255, 0, 255 } },
+        { { -0.5f,  0.5f }, { 0, 0, 255, 255 } }
     };
+    const uint32_t triangle_indices[] = { 0, 1, 2 };
+    const SceneVertex quad_vertices[] = {
+        { { -0.5f, -0.5f }, { 255, 0, 0, 255 } },
+        { {  0.5f, -0.5f }, { 0, 255, 0, 255 } },
+        { {  0.5f,  0.5f }, { 0, 0, 255, 255 } },
+        { { -0.5f,  0.5f }, { 255, 255, 255, 255 } }
+    };
+    const uint32_t quad_indices[] = { 0, 1, 2, 2, 3, 0 };
 
-    vk::PipelineColorBlendAttachmentState blend_attach_create_info {
-        .blendEnable = static_cast<vk::Bool32>(false),
-        .colorWriteMask = vk::ColorComponentFlagBits::eR
-                        | vk::ColorComponentFlagBits::eG
-                        | vk::ColorComponentFlagBits::eB
-                        | vk::ColorComponentFlagBits::eA
+    MeshRange meshes[] = {
+        m_geometry.add_mesh(triangle_indices, m_geometry.append(0, triangle_vertices, 3)),
+        m_geometry.add_mesh(quad_indices, m_geometry.append(0, quad_vertices, 4))
     };
 
-    vk::PipelineColorBlendStateCreateInfo blend_state_create_info {
-        .logicOpEnable = static_cast<vk::Bool32>(false),
-        .logicOp = vk::LogicOp::eCopy,
-        .attachmentCount = 1,
-        .pAttachments = &blend_attach_create_info,
-        .blendConstants = std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 0.0f }
-    };
-
-    std::vector<vk::DynamicState> dynamic_states {
-        vk::DynamicState::eViewport,
-        vk::DynamicState::eScissor
-    };
-
-    vk::PipelineDynamicStateCreateInfo state_create_info {
-        .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
-        .pDynamicStates = dynamic_states.data()
-    };
-
-    vk::PipelineLayoutCreateInfo pipeline_layout_create_info {
-        .setLayoutCount = 0,
-        .pushConstantRangeCount = 0
-    };
-
-    m_pipeline_layout = m_device.createPipelineLayout(pipeline_layout_create_info);
-
-    vk::GraphicsPipelineCreateInfo pipeline_create_info {
-        .stageCount = 2,
-        .pStages = stages,
-        .pVertexInputState = &vertex_input_create_info,
-        .pInputAssemblyState = &input_assembly_create_info,
-        .pViewportState = &viewport_create_info,
-        .pRasterizationState = &rasterization_create_info,
-        .pMultisampleState = &multisampling_create_info,
-        .pDepthStencilState = nullptr,
-        .pColorBlendState = &blend_state_create_info,
-        .pDynamicState = &state_create_info,
-        .layout = m_pipeline_layout,
-        .renderPass = m_render_pass,
-        .subpass = 0,
-        .basePipelineHandle = nullptr,
-        .basePipelineIndex = -1
-    };
-    // auto pipelines = m_device.createGraphicsPipelines(VK_NULL_HANDLE, std::array<vk::GraphicsPipelineCreateInfo, 1>{pipeline_create_info});
-    // m_pipeline = *(pipelines.cbegin());
-    m_pipeline = m_device.createGraphicsPipeline(VK_NULL_HANDLE, pipeline_create_info).value;
-    m_device.destroyShaderModule(vs);
-    m_device.destroyShaderModule(fs);
-}
\ No newline at end of file
+    uint32_t instance_count = std::max(m_config.instance_count, 1u);
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instance_count))));
+    float cell = 2.0f / side;
+    std::vector<SceneInstance> instances(instance_count);
+    for (uint32_t i = 0; i < instance_count; ++i) {
+        instances[i] = SceneInstance {
+            .transform = { -1.0f + cell * (i % side + 0.5f), -1.0f + cell * (i / side + 0.5f), cell * 0.5f },
+            .color = { 255, 255, 255, 255 }
+        };
+    }
+    m_geometry.append(1, instances.data(), instance_count);
+
+    // Culling works per instance, so every instance also becomes an object with a bounding
+    // sphere around its mesh (the quad's half diagonal covers both meshes).
+    std::vector<CullObject> objects;
+    if (m_config.gpu_culling)
+        objects.reserve(instance_count);
+
+    uint32_t draw_count = std::clamp(m_config.draw_count, 1u, instance_count);
+    for (uint32_t d = 0; d < draw_count; ++d) {
+        uint32_t first = static_cast<uint32_t>(uint64_t(instance_count) * d / draw_count);
+        uint32_t last = static_cast<uint32_t>(uint64_t(instance_count) * (d + 1) / draw_count);
+        const MeshRange& mesh = meshes[d % 2];
+        m_geometry.add_draw(mesh, first, last - first);
+
+        for (uint32_t i = first; i < last && m_config.gpu_culling; ++i) {
+            const float* transform = instances[i].transform;
+            objects.push_back(CullObject {
+                .sphere = { transform[0], transform[1], 0.0f, transform[2] * 0.7072f },
+                .index_count = mesh.index_count,
+                .first_index = mesh.first_index,
+                .vertex_offset = mesh.vertex_offset,
+                .instance = i
+            });
+        }
+    }
+
+    m_geometry.upload(m_allocator, m_uploads);
+
+    if (!m_config.gpu_culling) return;
+    if (!m_caps.features.multiDrawIndirect || !m_caps.features.drawIndirectFirstInstance || !m_bindless.enabled()) {
+        std::cerr << "GPU culling needs multiDrawIndirect, drawIndirectFirstInstance and descriptor indexing, drawing everything\n";
+        return;
+    }
+
+    // The scene has no camera: clip space is the view, optionally shrunk by the frustum scale.
+    float scale = 1.0f / std::max(m_config.cull_frustum_scale, 0.001f);
+    m_cull_frustum = Frustum::from_view_projection({
+        scale, 0.0f, 0.0f, 0.0f,
+        0.0f, scale, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    });
+    m_culler.init(m_caps, m_allocator, m_uploads, m_bindless, objects, static_cast<uint32_t>(m_frames.size()));
+}
+
+// The cull pass synchronizes and reads back its own buffers, so the graph only sees it as a side
+// effect ordered before the main pass.
+void Application::create_frame_graph() {
+    if (!m_dynamic_rendering) return;
+
+    m_graph_target = m_frame_graph.import_image("target", vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+                                                m_surface ? ResourceAccess::Present : ResourceAccess::TransferRead);
+    if (m_culler.enabled()) {
+        m_frame_graph.add_pass("cull", [this](const vk::CommandBuffer& cmd) {
+            record_cull_pass(cmd, m_graph_frame_index);
+        }).side_effect();
+    }
+    m_frame_graph.add_pass("main", [this](const vk::CommandBuffer& cmd) {
+        record_main_pass(cmd, m_graph_frame_index, m_graph_image_index);
+    }).write(m_graph_target, ResourceAccess::ColorAttachmentWrite);
+    if (m_readback.enabled()) {
+        m_frame_graph.add_pass("readback", [this](const vk::CommandBuffer& cmd) {
+            record_readback(cmd, m_graph_image_index, vk::ImageLayout::eTransferSrcOptimal);
+        }).read(m_graph_target, ResourceAccess::TransferRead).side_effect();
+    }
+    m_frame_graph.compile(m_device, m_allocator);
+}
@@ -0,0 +1,219 @@
+#include <bindless.hpp>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t max_storage_buffers = 16384;
+constexpr uint32_t max_sampled_images = 16384;
+constexpr uint32_t max_samplers = 256;
+
+}
+
+uint32_t IndexAllocator::allocate() {
+    if (!m_free.empty()) {
+        uint32_t index = m_free.back();
+        m_free.pop_back();
+        return index;
+    }
+    if (m_next == m_capacity)
+        throw std::runtime_error("Out of bindless descriptor slots");
+    return m_next++;
+}
+
+void IndexAllocator::release(uint32_t index) {
+    m_free.push_back(index);
+}
+
+bool BindlessDescriptors::supported(const DeviceCapabilities& caps) {
+    const auto& features = caps.vulkan12_features;
+    return features.runtimeDescriptorArray
+        && features.descriptorBindingPartiallyBound
+        && features.descriptorBindingUpdateUnusedWhilePending
+        && features.descriptorBindingStorageBufferUpdateAfterBind
+        && features.descriptorBindingSampledImageUpdateAfterBind
+        && caps.features.shaderStorageBufferArrayDynamicIndexing
+        && caps.features.shaderSampledImageArrayDynamicIndexing;
+}
+
+void BindlessDescriptors::init(const vk::Device& device, const DeviceCapabilities& caps) {
+    m_device = device;
+
+    vk::PushConstantRange push_constant_range {
+        .stageFlags = push_constant_stages,
+        .offset = 0,
+        .size = push_constant_size
+    };
+
+    if (!supported(caps)) {
+        std::cerr << "Descriptor indexing is unsupported, pipelines get no descriptor set\n";
+        m_layout = m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo {
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &push_constant_range
+        });
+        return;
+    }
+
+    // Every descriptor in the set counts against the per-stage budget of each stage that sees it.
+    const auto& limits = caps.vulkan12_properties;
+    uint32_t per_stage = limits.maxPerStageUpdateAfterBindResources / 3;
+    std::array<uint32_t, 3> counts {
+        std::min({ max_storage_buffers, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                   limits.maxDescriptorSetUpdateAfterBindStorageBuffers, per_stage }),
+        std::min({ max_sampled_images, limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                   limits.maxDescriptorSetUpdateAfterBindSampledImages, per_stage }),
+        std::min({ max_samplers, limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+                   limits.maxDescriptorSetUpdateAfterBindSamplers, per_stage })
+    };
+    std::array<vk::DescriptorType, 3> types {
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eSampledImage,
+        vk::DescriptorType::eSampler
+    };
+
+    std::array<vk::DescriptorSetLayoutBinding, 3> bindings;
+    std::array<vk::DescriptorBindingFlags, 3> binding_flags;
+    std::array<vk::DescriptorPoolSize, 3> pool_sizes;
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i] = vk::DescriptorSetLayoutBinding {
+            .binding = i,
+            .descriptorType = types[i],
+            .descriptorCount = counts[i],
+            .stageFlags = vk::ShaderStageFlagBits::eAll
+        };
+        binding_flags[i] = vk::DescriptorBindingFlagBits::ePartiallyBound
+                         | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+                         | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+        pool_sizes[i] = vk::DescriptorPoolSize {
+            .type = types[i],
+            .descriptorCount = counts[i]
+        };
+        m_indices[i] = IndexAllocator(counts[i]);
+    }
+
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info {
+        .bindingCount = static_cast<uint32_t>(binding_flags.size()),
+        .pBindingFlags = binding_flags.data()
+    };
+    m_set_layout = m_device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo {
+        .pNext = &binding_flags_info,
+        .flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data()
+    });
+
+    m_pool = m_device.createDescriptorPool(vk::DescriptorPoolCreateInfo {
+        .flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+        .maxSets = 1,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data()
+    });
+    m_set = m_device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo {
+        .descriptorPool = m_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &m_set_layout
+    }).front();
+
+    m_layout = m_device.createPipelineLayout(vk::PipelineLayoutCreateInfo {
+        .setLayoutCount = 1,
+        .pSetLayouts = &m_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &push_constant_range
+    });
+}
+
+void BindlessDescriptors::destroy() {
+    if (!m_device) return;
+
+    m_device.destroyPipelineLayout(m_layout);
+    m_device.destroyDescriptorPool(m_pool);
+    m_device.destroyDescriptorSetLayout(m_set_layout);
+    m_set = nullptr;
+    m_device = nullptr;
+}
+
+uint32_t BindlessDescriptors::allocate(BindlessBinding binding) {
+    if (!m_set)
+        throw std::runtime_error("Bindless descriptors need descriptor indexing");
+    return m_indices[static_cast<uint32_t>(binding)].allocate();
+}
+
+void BindlessDescriptors::write(const vk::WriteDescriptorSet& write) {
+    m_device.updateDescriptorSets(write, nullptr);
+}
+
+uint32_t BindlessDescriptors::add_storage_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t index = allocate(BindlessBinding::StorageBuffer);
+    vk::DescriptorBufferInfo buffer_info {
+        .buffer = buffer,
+        .offset = offset,
+        .range = range
+    };
+    write(vk::WriteDescriptorSet {
+        .dstSet = m_set,
+        .dstBinding = static_cast<uint32_t>(BindlessBinding::StorageBuffer),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &buffer_info
+    });
+    return index;
+}
+
+uint32_t BindlessDescriptors::add_sampled_image(vk::ImageView view, vk::ImageLayout layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t index = allocate(BindlessBinding::SampledImage);
+    vk::DescriptorImageInfo image_info {
+        .imageView = view,
+        .imageLayout = layout
+    };
+    write(vk::WriteDescriptorSet {
+        .dstSet = m_set,
+        .dstBinding = static_cast<uint32_t>(BindlessBinding::SampledImage),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eSampledImage,
+        .pImageInfo = &image_info
+    });
+    return index;
+}
+
+uint32_t BindlessDescriptors::add_sampler(vk::Sampler sampler) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t index = allocate(BindlessBinding::Sampler);
+    vk::DescriptorImageInfo image_info {
+        .sampler = sampler
+    };
+    write(vk::WriteDescriptorSet {
+        .dstSet = m_set,
+        .dstBinding = static_cast<uint32_t>(BindlessBinding::Sampler),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eSampler,
+        .pImageInfo = &image_info
+    });
+    return index;
+}
+
+// Partially bound bindings allow the stale descriptor to stay behind; nothing may index it anymore.
+void BindlessDescriptors::release(BindlessBinding binding, uint32_t index) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indices[static_cast<uint32_t>(binding)].release(index);
+}
+
+uint32_t BindlessDescriptors::size(BindlessBinding binding) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_indices[static_cast<uint32_t>(binding)].size();
+}
+
+void BindlessDescriptors::bind(const vk::CommandBuffer& cmd, vk::PipelineBindPoint bind_point) const {
+    if (m_set)
+        cmd.bindDescriptorSets(bind_point, m_layout, 0, m_set, nullptr);
+}
+
+void BindlessDescriptors::push_constants(const vk::CommandBuffer& cmd, const void* data, uint32_t size) const {
+    cmd.pushConstants(m_layout, push_constant_stages, 0, size, data);
+}
@@ -0,0 +1,212 @@
+#include <culling.hpp>
+#include <spirv/cull_comp.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t command_stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+// Matches the push constant block of cull.comp.
+struct CullParams {
+    float planes[6][4];
+    uint32_t object_count;
+    uint32_t compact;
+    uint32_t objects;
+    uint32_t commands;
+    uint32_t counters;
+};
+static_assert(sizeof(CullParams) <= BindlessDescriptors::push_constant_size);
+
+// The counters are { drawn, tested }; drawn doubles as the draw count of the graphics pass.
+constexpr vk::DeviceSize counters_size = 2 * sizeof(uint32_t);
+
+}
+
+Frustum Frustum::from_view_projection(const std::array<float, 16>& m) {
+    auto row = [&m](int i) {
+        return std::array<float, 4>{ m[i], m[4 + i], m[8 + i], m[12 + i] };
+    };
+    auto combine = [](const std::array<float, 4>& a, const std::array<float, 4>& b, float sign) {
+        return std::array<float, 4>{ a[0] + sign * b[0], a[1] + sign * b[1], a[2] + sign * b[2], a[3] + sign * b[3] };
+    };
+
+    std::array<float, 4> r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+    Frustum frustum {
+        .planes = {
+            combine(r3, r0, 1.0f),
+            combine(r3, r0, -1.0f),
+            combine(r3, r1, 1.0f),
+            combine(r3, r1, -1.0f),
+            r2,
+            combine(r3, r2, -1.0f)
+        }
+    };
+
+    for (auto& plane : frustum.planes) {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (float& value : plane)
+                value /= length;
+        }
+    }
+    return frustum;
+}
+
+void GpuCuller::create_pipeline(const vk::Device& device, const vk::PipelineCache& cache, const BindlessDescriptors& bindless,
+                                uint32_t group_size) {
+    m_device = device;
+    m_group_size = group_size;
+    m_pipeline = build_pipeline(cache, bindless, cull_comp_spv);
+}
+
+vk::Pipeline GpuCuller::build_pipeline(const vk::PipelineCache& cache, const BindlessDescriptors& bindless,
+                                       std::span<const uint32_t> code) const {
+    // local_size_x_id = 0 in cull.comp; reloaded code keeps the size the dispatch was sized for.
+    SpecializationConstants constants;
+    constants.set(0, m_group_size);
+    std::array<vk::SpecializationMapEntry, SpecializationConstants::max_constants> entries;
+    vk::SpecializationInfo specialization = constants.info(entries);
+
+    vk::ShaderModule module = create_shader_module(m_device, code);
+    vk::ComputePipelineCreateInfo pipeline_create_info {
+        .stage = vk::PipelineShaderStageCreateInfo {
+            .stage = vk::ShaderStageFlagBits::eCompute,
+            .module = module,
+            .pName = "main",
+            .pSpecializationInfo = &specialization
+        },
+        .layout = bindless.layout()
+    };
+    vk::Pipeline pipeline = m_device.createComputePipeline(cache, pipeline_create_info).value;
+    m_device.destroyShaderModule(module);
+    return pipeline;
+}
+
+void GpuCuller::init(const DeviceCapabilities& caps, GpuAllocator& allocator, UploadService& uploads, BindlessDescriptors& bindless,
+                     std::span<const CullObject> objects, uint32_t frames_in_flight) {
+    if (objects.empty()) return;
+
+    m_bindless = &bindless;
+    m_object_count = static_cast<uint32_t>(objects.size());
+    m_max_draw_indirect_count = caps.properties.limits.maxDrawIndirectCount;
+    // One count draw can't consume more commands than the limit, and survivors compacted past it
+    // would be dropped. Larger lists keep the commands in place and draw them in split ranges.
+    m_compact = caps.vulkan12_features.drawIndirectCount && m_object_count <= m_max_draw_indirect_count;
+    m_frame_recorded.assign(frames_in_flight, false);
+
+    auto create = [&allocator](vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties) {
+        return allocator.create_buffer(vk::BufferCreateInfo {
+            .size = size,
+            .usage = usage,
+            .sharingMode = vk::SharingMode::eExclusive
+        }, properties);
+    };
+
+    m_objects = create(objects.size_bytes(), 
+                       vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                       vk::MemoryPropertyFlagBits::eDeviceLocal);
+    m_commands = create(static_cast<vk::DeviceSize>(m_object_count) * command_stride,
+                        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                        vk::MemoryPropertyFlagBits::eDeviceLocal);
+    m_counters = create(counters_size,
+                        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+                      | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+                        vk::MemoryPropertyFlagBits::eDeviceLocal);
+    m_readback = create(counters_size * frames_in_flight, vk::BufferUsageFlagBits::eTransferDst,
+                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    uploads.upload_buffer_chunked(m_objects.buffer, 0, objects.data(), objects.size_bytes());
+
+    m_objects_index = bindless.add_storage_buffer(m_objects.buffer);
+    m_commands_index = bindless.add_storage_buffer(m_commands.buffer);
+    m_counters_index = bindless.add_storage_buffer(m_counters.buffer);
+}
+
+void GpuCuller::destroy(GpuAllocator& allocator) {
+    if (!m_device) return;
+
+    if (m_object_count > 0) {
+        allocator.destroy_buffer(m_objects);
+        allocator.destroy_buffer(m_commands);
+        allocator.destroy_buffer(m_counters);
+        allocator.destroy_buffer(m_readback);
+        m_bindless->release(BindlessBinding::StorageBuffer, m_objects_index);
+        m_bindless->release(BindlessBinding::StorageBuffer, m_commands_index);
+        m_bindless->release(BindlessBinding::StorageBuffer, m_counters_index);
+    }
+    m_device.destroyPipeline(m_pipeline);
+    m_object_count = 0;
+    m_device = nullptr;
+}
+
+void GpuCuller::record(const vk::CommandBuffer& cmd, uint32_t frame_index, const Frustum& frustum) {
+    auto barrier = [&cmd](vk::PipelineStageFlags src_stages, vk::AccessFlags src_access,
+                          vk::PipelineStageFlags dst_stages, vk::AccessFlags dst_access) {
+        vk::MemoryBarrier memory_barrier {
+            .srcAccessMask = src_access,
+            .dstAccessMask = dst_access
+        };
+        cmd.pipelineBarrier(src_stages, dst_stages, vk::DependencyFlags{}, memory_barrier, nullptr, nullptr);
+    };
+
+    // The previous frame may still be reading the commands and counters written last time.
+    barrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer 
+          | vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite,
+            vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+            vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite);
+    cmd.fillBuffer(m_counters.buffer, 0, counters_size, 0);
+    barrier(vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite,
+            vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+
+    CullParams params {
+        .object_count = m_object_count,
+        .compact = m_compact ? 1u : 0u,
+        .objects = m_objects_index,
+        .commands = m_commands_index,
+        .counters = m_counters_index
+    };
+    memcpy(params.planes, frustum.planes.data(), sizeof(params.planes));
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+    m_bindless->bind(cmd, vk::PipelineBindPoint::eCompute);
+    m_bindless->push_constants(cmd, &params, sizeof(params));
+    cmd.dispatch((m_object_count + m_group_size - 1) / m_group_size, 1, 1);
+
+    barrier(vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderWrite,
+            vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer,
+            vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead);
+    cmd.copyBuffer(m_counters.buffer, m_readback.buffer, vk::BufferCopy {
+        .srcOffset = 0,
+        .dstOffset = counters_size * frame_index,
+        .size = counters_size
+    });
+    barrier(vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite,
+            vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead);
+    m_frame_recorded[frame_index] = true;
+}
+
+void GpuCuller::draw(const vk::CommandBuffer& cmd) const {
+    if (m_compact) {
+        cmd.drawIndexedIndirectCount(m_commands.buffer, 0, m_counters.buffer, 0, m_object_count, command_stride);
+        return;
+    }
+
+    for (uint32_t first = 0; first < m_object_count; first += m_max_draw_indirect_count) {
+        uint32_t count = std::min(m_object_count - first, m_max_draw_indirect_count);
+        cmd.drawIndexedIndirect(m_commands.buffer, static_cast<vk::DeviceSize>(first) * command_stride, count, command_stride);
+    }
+}
+
+void GpuCuller::collect(uint32_t frame_index) {
+    if (m_object_count == 0 || !m_frame_recorded[frame_index]) return;
+
+    uint32_t counters[2];
+    memcpy(counters, static_cast<const char*>(m_readback.allocation.mapped) + counters_size * frame_index, sizeof(counters));
+    m_stats = CullStats {
+        .tested = counters[1],
+        .drawn = counters[0]
+    };
+}
@@ -0,0 +1,139 @@
+#include <debug_sink.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <ostream>
+
+namespace {
+
+static_assert((DebugMessageSink::capacity & (DebugMessageSink::capacity - 1)) == 0, "capacity must be a power of two");
+
+constexpr auto drain_interval = std::chrono::milliseconds(10);
+
+size_t severity_index(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    // The severity bits are 0x1, 0x10, 0x100 and 0x1000.
+    return std::min<size_t>(std::countr_zero(static_cast<uint32_t>(severity)) / 4, 3);
+}
+
+const char* severity_name(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    constexpr const char* names[] = { "verbose", "info", "warning", "error" };
+    return names[severity_index(severity)];
+}
+
+}
+
+DebugMessageSink::DebugMessageSink(std::ostream& out, uint32_t max_per_second, VkDebugUtilsMessageSeverityFlagBitsEXT min_printed)
+    : m_slots(std::make_unique<Slot[]>(capacity)), m_out(out), m_max_per_second(max_per_second), m_min_printed(min_printed) {
+    for (size_t i = 0; i < capacity; ++i)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    m_thread = std::thread(&DebugMessageSink::writer, this);
+}
+
+DebugMessageSink::~DebugMessageSink() {
+    m_stop.store(true, std::memory_order_release);
+    m_thread.join();
+}
+
+// Bounded MPSC ring: a slot is free for the producer at position p when its sequence is p, and
+// ready for the consumer when it is p + 1.
+bool DebugMessageSink::push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type,
+                            const VkDebugUtilsMessengerCallbackDataEXT* data) {
+    m_severity_counts[severity_index(severity)].fetch_add(1, std::memory_order_relaxed);
+    for (size_t bit = 0; bit < m_type_counts.size(); ++bit)
+        if (type & (1u << bit))
+            m_type_counts[bit].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t position = m_head.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &m_slots[position & (capacity - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(sequence - position);
+        if (diff == 0) {
+            if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->severity = severity;
+    slot->id = data->messageIdNumber;
+    const char* message = data->pMessage ? data->pMessage : "";
+    size_t length = std::min(std::strlen(message), max_message_length - 1);
+    std::memcpy(slot->message, message, length);
+    slot->message[length] = '\0';
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool DebugMessageSink::pop(Slot& out) {
+    Slot& slot = m_slots[m_tail & (capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1)
+        return false;
+
+    out.severity = slot.severity;
+    out.id = slot.id;
+    std::memcpy(out.message, slot.message, std::strlen(slot.message) + 1);
+    slot.sequence.store(m_tail + capacity, std::memory_order_release);
+    ++m_tail;
+    return true;
+}
+
+DebugMessageCounts DebugMessageSink::counts() const {
+    DebugMessageCounts counts;
+    for (size_t i = 0; i < counts.severity.size(); ++i)
+        counts.severity[i] = m_severity_counts[i].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < counts.type.size(); ++i)
+        counts.type[i] = m_type_counts[i].load(std::memory_order_relaxed);
+    counts.dropped = m_dropped.load(std::memory_order_relaxed);
+    counts.suppressed = m_suppressed.load(std::memory_order_relaxed);
+    return counts;
+}
+
+// Polls instead of waiting on a condition variable so producers never make a syscall.
+void DebugMessageSink::writer() {
+    auto slot = std::make_unique<Slot>();
+    for (;;) {
+        bool stopping = m_stop.load(std::memory_order_acquire);
+        Clock::time_point now = Clock::now();
+        while (pop(*slot))
+            write(*slot, now);
+        for (auto& [id, limit] : m_limits)
+            if (stopping || now - limit.window_start >= std::chrono::seconds(1))
+                flush_suppressed(id, limit);
+        m_out.flush();
+
+        if (stopping) break;
+        std::this_thread::sleep_for(drain_interval);
+    }
+}
+
+void DebugMessageSink::write(const Slot& slot, Clock::time_point now) {
+    if (slot.severity < m_min_printed) return;
+
+    RateLimit& limit = m_limits[slot.id];
+    if (now - limit.window_start >= std::chrono::seconds(1)) {
+        flush_suppressed(slot.id, limit);
+        limit.window_start = now;
+        limit.printed = 0;
+    }
+    if (limit.printed >= m_max_per_second) {
+        ++limit.suppressed;
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ++limit.printed;
+    m_out << "Validation layer (" << severity_name(slot.severity) << "): " << slot.message << "\n";
+}
+
+void DebugMessageSink::flush_suppressed(int32_t id, RateLimit& limit) {
+    if (limit.suppressed == 0) return;
+    m_out << "Validation layer: message 0x" << std::hex << static_cast<uint32_t>(id) << std::dec
+          << " repeated " << limit.suppressed << " more times\n";
+    limit.suppressed = 0;
+}
@@ -0,0 +1,114 @@
+#include <deletion_queue.hpp>
+#include <algorithm>
+#include <iterator>
+
+void DeletionQueue::init(const vk::Device& device, GpuAllocator& allocator) {
+    m_device = device;
+    m_allocator = &allocator;
+}
+
+void DeletionQueue::destroy() {
+    flush();
+    m_timelines.clear();
+}
+
+void DeletionQueue::retire(DeferredHandle handle, uint64_t last_frame) {
+    std::lock_guard lock(m_mutex);
+    enqueue(m_frame_batches, std::move(handle), last_frame);
+    ++m_stats.queued;
+}
+
+void DeletionQueue::retire(DeferredHandle handle, vk::Semaphore timeline, uint64_t value) {
+    std::lock_guard lock(m_mutex);
+    auto it = std::find_if(m_timelines.begin(), m_timelines.end(), [timeline](const Timeline& candidate) {
+        return candidate.semaphore == timeline;
+    });
+    if (it == m_timelines.end())
+        it = m_timelines.insert(m_timelines.end(), Timeline { .semaphore = timeline });
+    enqueue(it->batches, std::move(handle), value);
+    ++m_stats.queued;
+}
+
+void DeletionQueue::collect(uint64_t completed_frame) {
+    std::vector<Batch> ready;
+    {
+        std::lock_guard lock(m_mutex);
+        take_ready(m_frame_batches, completed_frame, ready);
+        for (auto& timeline : m_timelines) {
+            if (!timeline.batches.empty())
+                take_ready(timeline.batches, m_device.getSemaphoreCounterValue(timeline.semaphore), ready);
+        }
+    }
+    // Destroyed outside the lock so a long batch never blocks retire() on another thread.
+    release(ready);
+}
+
+void DeletionQueue::flush() {
+    std::vector<Batch> ready;
+    {
+        std::lock_guard lock(m_mutex);
+        take_ready(m_frame_batches, UINT64_MAX, ready);
+        for (auto& timeline : m_timelines)
+            take_ready(timeline.batches, UINT64_MAX, ready);
+    }
+    release(ready);
+}
+
+DeletionStats DeletionQueue::stats() const {
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+// Batches are kept sorted by key. Retiring at the newest key, by far the common case, appends to
+// the last batch; an older key walks back to where it belongs.
+void DeletionQueue::enqueue(std::deque<Batch>& batches, DeferredHandle handle, uint64_t key) {
+    auto it = batches.end();
+    while (it != batches.begin() && std::prev(it)->key > key)
+        --it;
+    if (it == batches.begin() || std::prev(it)->key != key)
+        it = std::next(batches.insert(it, Batch { .key = key }));
+    std::prev(it)->handles.push_back(std::move(handle));
+}
+
+void DeletionQueue::take_ready(std::deque<Batch>& batches, uint64_t completed, std::vector<Batch>& ready) {
+    while (!batches.empty() && batches.front().key <= completed) {
+        ready.push_back(std::move(batches.front()));
+        batches.pop_front();
+    }
+}
+
+void DeletionQueue::release(std::vector<Batch>& ready) {
+    if (ready.empty()) return;
+
+    uint64_t released = 0;
+    for (const auto& batch : ready) {
+        // In retirement order, so e.g. framebuffers go before the views they reference.
+        for (const auto& handle : batch.handles)
+            release(handle);
+        released += batch.handles.size();
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_stats.released += released;
+    m_stats.batches += ready.size();
+}
+
+void DeletionQueue::release(const DeferredHandle& handle) {
+    struct Visitor {
+        DeletionQueue& queue;
+
+        void operator()(vk::Pipeline pipeline) const { queue.m_device.destroyPipeline(pipeline); }
+        void operator()(vk::PipelineLayout layout) const { queue.m_device.destroyPipelineLayout(layout); }
+        void operator()(vk::ShaderModule module) const { queue.m_device.destroyShaderModule(module); }
+        void operator()(vk::RenderPass render_pass) const { queue.m_device.destroyRenderPass(render_pass); }
+        void operator()(vk::Framebuffer framebuffer) const { queue.m_device.destroyFramebuffer(framebuffer); }
+        void operator()(vk::ImageView view) const { queue.m_device.destroyImageView(view); }
+        void operator()(vk::Sampler sampler) const { queue.m_device.destroySampler(sampler); }
+        void operator()(vk::DescriptorSetLayout layout) const { queue.m_device.destroyDescriptorSetLayout(layout); }
+        void operator()(vk::SwapchainKHR swapchain) const { queue.m_device.destroySwapchainKHR(swapchain); }
+        void operator()(vk::Semaphore semaphore) const { queue.m_device.destroySemaphore(semaphore); }
+        void operator()(const AllocatedBuffer& buffer) const { queue.m_allocator->destroy_buffer(buffer); }
+        void operator()(const AllocatedImage& image) const { queue.m_allocator->destroy_image(image); }
+    };
+    std::visit(Visitor { *this }, handle);
+}
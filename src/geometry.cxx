@@ -0,0 +1,216 @@
+#include <geometry.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+uint32_t format_size(vk::Format format) {
+    switch (format) {
+        case vk::Format::eR8Unorm:
+        case vk::Format::eR8Snorm:
+        case vk::Format::eR8Uint:
+        case vk::Format::eR8Sint:
+            return 1;
+        case vk::Format::eR8G8Unorm:
+        case vk::Format::eR8G8Snorm:
+        case vk::Format::eR8G8Uint:
+        case vk::Format::eR8G8Sint:
+        case vk::Format::eR16Sfloat:
+        case vk::Format::eR16Unorm:
+        case vk::Format::eR16Snorm:
+        case vk::Format::eR16Uint:
+        case vk::Format::eR16Sint:
+            return 2;
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Snorm:
+        case vk::Format::eR8G8B8A8Uint:
+        case vk::Format::eR8G8B8A8Sint:
+        case vk::Format::eA2B10G10R10UnormPack32:
+        case vk::Format::eA2B10G10R10SnormPack32:
+        case vk::Format::eR16G16Sfloat:
+        case vk::Format::eR16G16Unorm:
+        case vk::Format::eR16G16Snorm:
+        case vk::Format::eR16G16Uint:
+        case vk::Format::eR16G16Sint:
+        case vk::Format::eR32Sfloat:
+        case vk::Format::eR32Uint:
+        case vk::Format::eR32Sint:
+            return 4;
+        case vk::Format::eR16G16B16A16Sfloat:
+        case vk::Format::eR16G16B16A16Unorm:
+        case vk::Format::eR16G16B16A16Snorm:
+        case vk::Format::eR16G16B16A16Uint:
+        case vk::Format::eR16G16B16A16Sint:
+        case vk::Format::eR32G32Sfloat:
+        case vk::Format::eR32G32Uint:
+        case vk::Format::eR32G32Sint:
+            return 8;
+        case vk::Format::eR32G32B32Sfloat:
+        case vk::Format::eR32G32B32Uint:
+        case vk::Format::eR32G32B32Sint:
+            return 12;
+        case vk::Format::eR32G32B32A32Sfloat:
+        case vk::Format::eR32G32B32A32Uint:
+        case vk::Format::eR32G32B32A32Sint:
+            return 16;
+        default:
+            throw std::runtime_error("Unsupported vertex attribute format " + vk::to_string(format));
+    }
+}
+
+uint32_t VertexStream::stride() const {
+    uint32_t stride = 0;
+    for (const auto& attribute : attributes)
+        stride += format_size(attribute.format);
+    return stride;
+}
+
+std::vector<vk::VertexInputBindingDescription> VertexFormat::bindings() const {
+    std::vector<vk::VertexInputBindingDescription> bindings;
+    for (uint32_t i = 0; i < streams.size(); ++i) {
+        bindings.push_back(vk::VertexInputBindingDescription {
+            .binding = i,
+            .stride = streams[i].stride(),
+            .inputRate = streams[i].input_rate
+        });
+    }
+    return bindings;
+}
+
+std::vector<vk::VertexInputAttributeDescription> VertexFormat::attributes() const {
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+    for (uint32_t i = 0; i < streams.size(); ++i) {
+        uint32_t offset = 0;
+        for (const auto& attribute : streams[i].attributes) {
+            attributes.push_back(vk::VertexInputAttributeDescription {
+                .location = attribute.location,
+                .binding = i,
+                .format = attribute.format,
+                .offset = offset
+            });
+            offset += format_size(attribute.format);
+        }
+    }
+    return attributes;
+}
+
+void GeometryBatch::init(const DeviceCapabilities& caps, const VertexFormat& format) {
+    m_format = format;
+    m_stream_data.assign(format.streams.size(), {});
+
+    m_multi_draw = caps.features.multiDrawIndirect && caps.features.drawIndirectFirstInstance;
+    m_draw_indirect_count = m_multi_draw && caps.vulkan12_features.drawIndirectCount;
+    m_max_draw_indirect_count = m_multi_draw ? caps.properties.limits.maxDrawIndirectCount : 1;
+}
+
+void GeometryBatch::destroy(GpuAllocator& allocator) {
+    for (const auto& stream : m_streams)
+        allocator.destroy_buffer(stream);
+    m_streams.clear();
+    m_stream_buffers.clear();
+    if (m_index.buffer)
+        allocator.destroy_buffer(m_index);
+    if (m_indirect.buffer)
+        allocator.destroy_buffer(m_indirect);
+    if (m_count.buffer)
+        allocator.destroy_buffer(m_count);
+    m_index = {};
+    m_indirect = {};
+    m_count = {};
+}
+
+uint32_t GeometryBatch::append(uint32_t stream, const void* data, uint32_t count) {
+    uint32_t stride = m_format.streams.at(stream).stride();
+    auto& bytes = m_stream_data[stream];
+    uint32_t first = static_cast<uint32_t>(bytes.size() / stride);
+
+    const std::byte* src = static_cast<const std::byte*>(data);
+    bytes.insert(bytes.end(), src, src + static_cast<size_t>(count) * stride);
+
+    if (m_format.streams[stream].input_rate == vk::VertexInputRate::eInstance)
+        m_instance_count = std::max(m_instance_count, first + count);
+    return first;
+}
+
+MeshRange GeometryBatch::add_mesh(std::span<const uint32_t> indices, uint32_t first_vertex) {
+    MeshRange mesh {
+        .first_index = static_cast<uint32_t>(m_indices.size()),
+        .index_count = static_cast<uint32_t>(indices.size()),
+        .vertex_offset = static_cast<int32_t>(first_vertex)
+    };
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+    return mesh;
+}
+
+void GeometryBatch::add_draw(const MeshRange& mesh, uint32_t first_instance, uint32_t instance_count) {
+    m_commands.push_back(vk::DrawIndexedIndirectCommand {
+        .indexCount = mesh.index_count,
+        .instanceCount = instance_count,
+        .firstIndex = mesh.first_index,
+        .vertexOffset = mesh.vertex_offset,
+        .firstInstance = first_instance
+    });
+}
+
+void GeometryBatch::upload(GpuAllocator& allocator, UploadService& uploads) {
+    auto create = [&](vk::DeviceSize size, vk::BufferUsageFlags usage, const void* data) {
+        vk::BufferCreateInfo buffer_create_info {
+            .size = std::max<vk::DeviceSize>(size, 4),
+            .usage = usage | vk::BufferUsageFlagBits::eTransferDst,
+            .sharingMode = vk::SharingMode::eExclusive
+        };
+        AllocatedBuffer buffer = allocator.create_buffer(buffer_create_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        if (size > 0)
+            uploads.upload_buffer_chunked(buffer.buffer, 0, data, size);
+        return buffer;
+    };
+
+    for (const auto& bytes : m_stream_data) {
+        m_streams.push_back(create(bytes.size(), vk::BufferUsageFlagBits::eVertexBuffer, bytes.data()));
+        m_stream_buffers.push_back(m_streams.back().buffer);
+    }
+    m_index = create(m_indices.size() * sizeof(uint32_t), vk::BufferUsageFlagBits::eIndexBuffer, m_indices.data());
+
+    // Storage usage lets a compute pass rewrite the commands and the count on the GPU.
+    m_indirect = create(m_commands.size() * sizeof(vk::DrawIndexedIndirectCommand), 
+                        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer, 
+                        m_commands.data());
+    uint32_t count = draw_count();
+    m_count = create(sizeof(count), 
+                     vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer, 
+                     &count);
+
+    m_stream_data.assign(m_stream_data.size(), {});
+    m_indices = {};
+}
+
+void GeometryBatch::bind(const vk::CommandBuffer& cmd) const {
+    std::vector<vk::DeviceSize> offsets(m_stream_buffers.size(), 0);
+    cmd.bindVertexBuffers(0, m_stream_buffers, offsets);
+    cmd.bindIndexBuffer(m_index.buffer, 0, vk::IndexType::eUint32);
+}
+
+void GeometryBatch::draw(const vk::CommandBuffer& cmd, uint32_t first_draw, uint32_t draw_count) const {
+    draw_count = std::min(draw_count, this->draw_count() - std::min(first_draw, this->draw_count()));
+
+    if (!m_multi_draw) {
+        for (uint32_t i = first_draw; i < first_draw + draw_count; ++i) {
+            const auto& command = m_commands[i];
+            cmd.drawIndexed(command.indexCount, command.instanceCount, command.firstIndex, 
+                            command.vertexOffset, command.firstInstance);
+        }
+        return;
+    }
+
+    constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+    while (draw_count > 0) {
+        uint32_t count = std::min(draw_count, m_max_draw_indirect_count);
+        vk::DeviceSize offset = static_cast<vk::DeviceSize>(first_draw) * stride;
+        // The count buffer holds the whole batch, so min(count buffer, count) keeps each range exact.
+        if (m_draw_indirect_count)
+            cmd.drawIndexedIndirectCount(m_indirect.buffer, offset, m_count.buffer, 0, count, stride);
+        else
+            cmd.drawIndexedIndirect(m_indirect.buffer, offset, count, stride);
+        first_draw += count;
+        draw_count -= count;
+    }
+}
@@ -0,0 +1,185 @@
+#include <gpu_tasks.hpp>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+vk::Semaphore create_timeline(const vk::Device& device) {
+    vk::SemaphoreTypeCreateInfo timeline_info {
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue = 0
+    };
+    return device.createSemaphore(vk::SemaphoreCreateInfo { .pNext = &timeline_info });
+}
+
+}
+
+void TaskScheduler::init(const vk::Device& device, ThreadPool& pool) {
+    m_device = device;
+    m_pool = &pool;
+    m_wake = create_timeline(m_device);
+    m_timeline = create_timeline(m_device);
+    m_stop = false;
+    m_error = nullptr;
+    m_waiter = std::thread(&TaskScheduler::waiter, this);
+}
+
+void TaskScheduler::destroy() {
+    if (!m_device) return;
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+        wake_locked();
+    }
+    m_waiter.join();
+    if (!m_pending.empty())
+        std::cerr << "Abandoned " << m_pending.size() << " tasks still waiting on the GPU\n";
+    m_pending.clear();
+
+    m_device.destroySemaphore(m_wake);
+    m_device.destroySemaphore(m_timeline);
+    m_device = nullptr;
+}
+
+TimelinePoint TaskScheduler::submit(const vk::Queue& queue, std::span<const vk::CommandBuffer> cmds,
+                                    std::span<const TimelinePoint> waits, vk::PipelineStageFlags wait_stages) {
+    std::vector<vk::Semaphore> wait_semaphores;
+    std::vector<uint64_t> wait_values;
+    for (const auto& point : waits) {
+        wait_semaphores.push_back(point.semaphore);
+        wait_values.push_back(point.value);
+    }
+    std::vector<vk::PipelineStageFlags> stages(waits.size(), wait_stages);
+
+    std::lock_guard lock(m_submit_mutex);
+    uint64_t value = m_submitted + 1;
+    vk::TimelineSemaphoreSubmitInfo timeline_submit_info {
+        .waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size()),
+        .pWaitSemaphoreValues = wait_values.data(),
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value
+    };
+    vk::SubmitInfo submit_info {
+        .pNext = &timeline_submit_info,
+        .waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size()),
+        .pWaitSemaphores = wait_semaphores.data(),
+        .pWaitDstStageMask = stages.data(),
+        .commandBufferCount = static_cast<uint32_t>(cmds.size()),
+        .pCommandBuffers = cmds.data(),
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &m_timeline
+    };
+    queue.submit(submit_info);
+    m_submitted = value;
+    return TimelinePoint { m_timeline, value };
+}
+
+void TaskScheduler::resume_on_pool(std::coroutine_handle<> handle) {
+    // The future is dropped: coroutines keep their exceptions in their promise.
+    m_pool->submit([handle]() { handle.resume(); });
+}
+
+bool TaskScheduler::is_complete(const GpuAwaiter& awaiter) const {
+    if (awaiter.fence)
+        return m_device.getFenceStatus(awaiter.fence) == vk::Result::eSuccess;
+    return m_device.getSemaphoreCounterValue(awaiter.point.semaphore) >= awaiter.point.value;
+}
+
+void TaskScheduler::enqueue(GpuAwaiter* awaiter) {
+    std::lock_guard lock(m_mutex);
+    if (m_error) {
+        awaiter->error = m_error;
+        resume_on_pool(awaiter->handle);
+        return;
+    }
+    m_pending.push_back(awaiter);
+    wake_locked();
+}
+
+void TaskScheduler::wake_locked() {
+    m_device.signalSemaphore(vk::SemaphoreSignalInfo {
+        .semaphore = m_wake,
+        .value = ++m_wake_value
+    });
+}
+
+void TaskScheduler::waiter() {
+    std::vector<vk::Semaphore> semaphores;
+    std::vector<uint64_t> values;
+    std::vector<GpuAwaiter*> ready;
+
+    while (true) {
+        bool fences = false;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_stop)
+                return;
+
+            // Any wait enqueued after this snapshot signals a later wake value and ends the wait.
+            semaphores.assign(1, m_wake);
+            values.assign(1, m_wake_value + 1);
+            for (const GpuAwaiter* awaiter : m_pending) {
+                if (awaiter->fence) {
+                    fences = true;
+                    continue;
+                }
+                // One entry per semaphore, at the lowest value anybody waits for.
+                auto it = std::find(semaphores.begin(), semaphores.end(), awaiter->point.semaphore);
+                if (it == semaphores.end()) {
+                    semaphores.push_back(awaiter->point.semaphore);
+                    values.push_back(awaiter->point.value);
+                } else {
+                    uint64_t& value = values[it - semaphores.begin()];
+                    value = std::min(value, awaiter->point.value);
+                }
+            }
+        }
+
+        std::exception_ptr error;
+        try {
+            vk::SemaphoreWaitInfo wait_info {
+                .flags = vk::SemaphoreWaitFlagBits::eAny,
+                .semaphoreCount = static_cast<uint32_t>(semaphores.size()),
+                .pSemaphores = semaphores.data(),
+                .pValues = values.data()
+            };
+            uint64_t timeout = fences
+                ? std::chrono::duration_cast<std::chrono::nanoseconds>(fence_poll_interval).count()
+                : UINT64_MAX;
+            vk::Result result = m_device.waitSemaphores(wait_info, timeout);
+            if (result != vk::Result::eSuccess && result != vk::Result::eTimeout)
+                throw std::runtime_error("Failed to wait for task timelines: " + vk::to_string(result));
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            std::erase_if(m_pending, [&](GpuAwaiter* awaiter) {
+                if (!error) {
+                    try {
+                        if (!is_complete(*awaiter))
+                            return false;
+                    } catch (...) {
+                        awaiter->error = std::current_exception();
+                    }
+                } else {
+                    awaiter->error = error;
+                }
+                ready.push_back(awaiter);
+                return true;
+            });
+            // Waiting again would fail the same way at once; later waits take the error instead.
+            if (error)
+                m_error = error;
+        }
+        // Resumed on the pool so one long continuation never delays the other waits.
+        for (GpuAwaiter* awaiter : ready)
+            resume_on_pool(awaiter->handle);
+        ready.clear();
+        if (error)
+            return;
+    }
+}
@@ -0,0 +1,31 @@
+#include <latency.hpp>
+
+namespace {
+
+constexpr size_t latency_window = 1000;
+
+}
+
+void LatencyTracker::frame_started(uint64_t id, const std::string& mode, Clock::time_point input_time) {
+    m_pending.push_back(Pending { id, mode, input_time });
+}
+
+void LatencyTracker::frame_completed(uint64_t id, Clock::time_point time) {
+    while (!m_pending.empty() && m_pending.front().id <= id) {
+        const Pending& pending = m_pending.front();
+        if (pending.id == id) {
+            auto& samples = m_samples[pending.mode];
+            samples.push_back(std::chrono::duration<double, std::milli>(time - pending.input_time).count());
+            if (samples.size() > latency_window)
+                samples.pop_front();
+        }
+        m_pending.pop_front();
+    }
+}
+
+std::vector<LatencyStats> LatencyTracker::stats() const {
+    std::vector<LatencyStats> stats;
+    for (const auto& [mode, samples] : m_samples)
+        stats.push_back(LatencyStats { mode, summarize_frame_times(std::vector<double>(samples.begin(), samples.end())) });
+    return stats;
+}
@@ -1,12 +1,104 @@
 #include <application.hpp>
 #include <iostream>
 #include <limits>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <cctype>
 
-int main() {
+namespace {
+
+vk::PresentModeKHR parse_present_mode(const std::string& name) {
+    if (name == "fifo") return vk::PresentModeKHR::eFifo;
+    if (name == "fifo-relaxed") return vk::PresentModeKHR::eFifoRelaxed;
+    if (name == "mailbox") return vk::PresentModeKHR::eMailbox;
+    if (name == "immediate") return vk::PresentModeKHR::eImmediate;
+    throw std::runtime_error("Unknown present mode " + name + " (fifo, fifo-relaxed, mailbox, immediate)");
+}
+
+ReadbackFileFormat parse_readback_format(const std::string& name) {
+    if (name == "raw") return ReadbackFileFormat::Raw;
+    if (name == "ppm") return ReadbackFileFormat::Ppm;
+    if (name == "png") return ReadbackFileFormat::Png;
+    throw std::runtime_error("Unknown readback format " + name + " (raw, ppm, png)");
+}
+
+}
+
+int main(int argc, char** argv) {
     // std::cout << std::numeric_limits<uint32_t>::max() << "\n";
 
+    ApplicationConfig config;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            config.headless = true;
+        } else if (strcmp(argv[i], "--offscreen") == 0) {
+            config.headless = true;
+            config.use_headless_surface = false;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            config.max_frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            config.frames_in_flight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            try {
+                config.present_mode = parse_present_mode(argv[++i]);
+            } catch (std::exception& e) {
+                std::cout << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--swapchain-images") == 0 && i + 1 < argc) {
+            config.swapchain_image_count = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--shader-pack") == 0 && i + 1 < argc) {
+            config.shader_pack_path = argv[++i];
+        } else if (strcmp(argv[i], "--pipeline-permutations") == 0) {
+            config.compile_pipeline_permutations = true;
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            std::string device = argv[++i];
+            if (!device.empty() && std::all_of(device.begin(), device.end(), ::isdigit))
+                config.device_index = std::stoi(device);
+            else
+                config.device_name = device;
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            config.instance_count = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            config.draw_count = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+            config.record_threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--dynamic-rendering") == 0) {
+            config.dynamic_rendering = true;
+        } else if (strcmp(argv[i], "--gpu-culling") == 0) {
+            config.gpu_culling = true;
+        } else if (strcmp(argv[i], "--cull-frustum-scale") == 0 && i + 1 < argc) {
+            config.gpu_culling = true;
+            config.cull_frustum_scale = std::stof(argv[++i]);
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            config.memory_budget_limit = std::stoull(argv[++i]) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--cull-group-size") == 0 && i + 1 < argc) {
+            config.gpu_culling = true;
+            config.cull_group_size = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--readback") == 0 && i + 1 < argc) {
+            config.readback_path = argv[++i];
+        } else if (strcmp(argv[i], "--readback-format") == 0 && i + 1 < argc) {
+            try {
+                config.readback_format = parse_readback_format(argv[++i]);
+            } catch (std::exception& e) {
+                std::cout << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--readback-latency") == 0 && i + 1 < argc) {
+            config.readback_latency = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--hot-reload") == 0) {
+            config.hot_reload = true;
+        } else if (strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc) {
+            config.shader_source_dir = argv[++i];
+        } else if (strcmp(argv[i], "--glslc") == 0 && i + 1 < argc) {
+            config.shader_compiler = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            config.trace_path = argv[++i];
+        }
+    }
 
-    Application app;
+    Application app(config);
     try {
         app.run();
     } catch(std::exception& e) {
@@ -15,4 +107,4 @@ int main() {
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,154 @@
+#include <memory_budget.hpp>
+#include <algorithm>
+
+void MemoryBudget::init(const vk::PhysicalDevice& phy_device, GpuAllocator& allocator, bool memory_budget_ext,
+                        vk::DeviceSize budget_limit) {
+    m_phy_device = phy_device;
+    m_allocator = &allocator;
+    m_memory_budget_ext = memory_budget_ext;
+    m_budget_limit = budget_limit;
+    m_stats = MemoryBudgetStats { .estimated = !memory_budget_ext };
+
+    const vk::PhysicalDeviceMemoryProperties& properties = allocator.memory_properties();
+    m_heaps.assign(properties.memoryHeapCount, Heap{});
+    for (uint32_t i = 0; i < properties.memoryHeapCount; ++i) {
+        m_heaps[i].budget.size = properties.memoryHeaps[i].size;
+        m_heaps[i].budget.device_local = static_cast<bool>(properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    }
+
+    update();
+    m_allocator->set_budget_check([this](uint32_t heap, vk::DeviceSize size) { check(heap, size); });
+}
+
+void MemoryBudget::destroy() {
+    if (!m_allocator) return;
+
+    m_allocator->set_budget_check(nullptr);
+    m_allocator = nullptr;
+    std::lock_guard lock(m_evict_mutex);
+    m_handlers.clear();
+}
+
+void MemoryBudget::update() {
+    std::vector<vk::DeviceSize> reserved(m_heaps.size());
+    for (uint32_t i = 0; i < m_heaps.size(); ++i)
+        reserved[i] = m_allocator->reserved_bytes(i);
+
+    vk::PhysicalDeviceMemoryBudgetPropertiesEXT driver;
+    if (m_memory_budget_ext) {
+        auto properties = m_phy_device.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+                                                             vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        driver = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+    }
+
+    std::vector<vk::DeviceSize> usage(m_heaps.size());
+    {
+        std::lock_guard lock(m_mutex);
+        for (uint32_t i = 0; i < m_heaps.size(); ++i) {
+            HeapBudget& heap = m_heaps[i].budget;
+            // Some drivers leave heaps they don't track at 0; those fall back to the estimate too.
+            if (m_memory_budget_ext && driver.heapBudget[i] > 0) {
+                heap.usage = driver.heapUsage[i];
+                heap.budget = driver.heapBudget[i];
+            } else {
+                heap.usage = reserved[i];
+                heap.budget = static_cast<vk::DeviceSize>(heap.size * estimated_budget_share);
+            }
+            if (m_budget_limit > 0 && heap.device_local)
+                heap.budget = std::min(heap.budget, m_budget_limit);
+            heap.peak_usage = std::max(heap.peak_usage, heap.usage);
+            m_heaps[i].reserved_at_sample = reserved[i];
+            usage[i] = heap.usage;
+        }
+        ++m_stats.samples;
+    }
+
+    for (uint32_t i = 0; i < m_heaps.size(); ++i)
+        evict_if_needed(i, usage[i], false);
+}
+
+void MemoryBudget::check(uint32_t heap, vk::DeviceSize size) {
+    vk::DeviceSize reserved = m_allocator->reserved_bytes(heap);
+    vk::DeviceSize projected;
+    {
+        std::lock_guard lock(m_mutex);
+        const Heap& state = m_heaps[heap];
+        // Only growth since the sample counts; blocks freed since then are already gone from it.
+        vk::DeviceSize growth = reserved > state.reserved_at_sample ? reserved - state.reserved_at_sample : 0;
+        projected = state.budget.usage + growth + size;
+    }
+    evict_if_needed(heap, projected, true);
+}
+
+void MemoryBudget::evict_if_needed(uint32_t heap, vk::DeviceSize usage, bool allocating) {
+    EvictionRequest request;
+    {
+        std::lock_guard lock(m_mutex);
+        Heap& state = m_heaps[heap];
+        vk::DeviceSize& evicted_at = allocating ? state.allocation_evicted_at : state.evicted_at;
+        vk::DeviceSize budget = state.budget.budget;
+        if (budget == 0 || usage < budget * evict_threshold) {
+            evicted_at = 0;
+            return;
+        }
+        if (usage <= evicted_at)
+            return;
+        evicted_at = usage;
+
+        vk::DeviceSize target = static_cast<vk::DeviceSize>(budget * evict_target);
+        request = EvictionRequest {
+            .heap = heap,
+            .usage = usage,
+            .budget = budget,
+            .bytes = usage - target,
+            .allocating = allocating
+        };
+    }
+
+    std::unique_lock evicting(m_evict_mutex, std::try_to_lock);
+    if (!evicting)
+        return;
+
+    vk::DeviceSize wanted = request.bytes;
+    vk::DeviceSize released = 0;
+    for (auto& handler : m_handlers) {
+        if (released >= wanted)
+            break;
+        request.bytes = wanted - released;
+        vk::DeviceSize bytes = handler.handler(request);
+        handler.released_bytes += bytes;
+        released += bytes;
+    }
+    evicting.unlock();
+
+    std::lock_guard lock(m_mutex);
+    ++m_stats.evictions;
+    m_stats.allocation_evictions += allocating ? 1 : 0;
+    m_stats.evicted_bytes += released;
+}
+
+void MemoryBudget::add_eviction_handler(std::string name, EvictionHandler handler) {
+    std::lock_guard lock(m_evict_mutex);
+    m_handlers.push_back(NamedHandler { std::move(name), std::move(handler) });
+}
+
+std::vector<HeapBudget> MemoryBudget::heaps() const {
+    std::lock_guard lock(m_mutex);
+    std::vector<HeapBudget> heaps;
+    for (const auto& heap : m_heaps)
+        heaps.push_back(heap.budget);
+    return heaps;
+}
+
+MemoryBudgetStats MemoryBudget::stats() const {
+    MemoryBudgetStats stats;
+    {
+        std::lock_guard lock(m_mutex);
+        stats = m_stats;
+    }
+    // Between passes; a pass in progress is counted once it finishes.
+    std::lock_guard evicting(m_evict_mutex);
+    for (const auto& handler : m_handlers)
+        stats.handlers.push_back(EvictionHandlerStats { handler.name, handler.released_bytes });
+    return stats;
+}
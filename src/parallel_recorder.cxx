@@ -0,0 +1,78 @@
+#include <parallel_recorder.hpp>
+
+#include <algorithm>
+
+namespace {
+
+// More slices than workers leaves room for stealing to even out the load.
+constexpr uint32_t slices_per_worker = 4;
+constexpr uint32_t min_draws_per_slice = 64;
+
+}
+
+void ParallelRecorder::init(const vk::Device& device, uint32_t queue_family, uint32_t frames_in_flight, 
+                            WorkStealingScheduler& scheduler) {
+    m_device = device;
+    m_scheduler = &scheduler;
+
+    m_pools.resize(frames_in_flight);
+    for (auto& frame_pools : m_pools) {
+        frame_pools.resize(scheduler.size());
+        for (auto& worker_pool : frame_pools) {
+            worker_pool.pool = m_device.createCommandPool(vk::CommandPoolCreateInfo {
+                .flags = vk::CommandPoolCreateFlagBits::eTransient,
+                .queueFamilyIndex = queue_family
+            });
+        }
+    }
+}
+
+void ParallelRecorder::destroy() {
+    for (auto& frame_pools : m_pools) {
+        for (auto& worker_pool : frame_pools)
+            m_device.destroyCommandPool(worker_pool.pool);
+    }
+    m_pools.clear();
+}
+
+vk::CommandBuffer ParallelRecorder::next_buffer(WorkerPool& pool) {
+    if (pool.used == pool.buffers.size()) {
+        vk::CommandBufferAllocateInfo alloc_info {
+            .commandPool = pool.pool,
+            .level = vk::CommandBufferLevel::eSecondary,
+            .commandBufferCount = 1
+        };
+        pool.buffers.push_back(m_device.allocateCommandBuffers(alloc_info).front());
+    }
+    return pool.buffers[pool.used++];
+}
+
+const std::vector<vk::CommandBuffer>& ParallelRecorder::record(uint32_t frame_index, const vk::CommandBufferInheritanceInfo& inheritance,
+                                                               uint32_t draw_count, const RecordSlice& record_slice) {
+    auto& frame_pools = m_pools[frame_index];
+    for (auto& worker_pool : frame_pools) {
+        m_device.resetCommandPool(worker_pool.pool);
+        worker_pool.used = 0;
+    }
+
+    uint32_t slice_count = std::clamp(draw_count / min_draws_per_slice, 1u, m_scheduler->size() * slices_per_worker);
+    uint32_t draws_per_slice = (draw_count + slice_count - 1) / slice_count;
+    m_slices.assign(slice_count, vk::CommandBuffer{});
+
+    m_scheduler->parallel_for(slice_count, [&](uint32_t worker, uint32_t slice) {
+        vk::CommandBuffer cmd = next_buffer(frame_pools[worker]);
+        cmd.begin(vk::CommandBufferBeginInfo {
+            .flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+            .pInheritanceInfo = &inheritance
+        });
+
+        uint32_t first = std::min(slice * draws_per_slice, draw_count);
+        uint32_t count = std::min(draws_per_slice, draw_count - first);
+        record_slice(cmd, first, count);
+
+        cmd.end();
+        m_slices[slice] = cmd;
+    });
+
+    return m_slices;
+}
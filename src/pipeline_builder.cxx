@@ -0,0 +1,291 @@
+#include <pipeline_builder.hpp>
+
+#include <array>
+#include <future>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+constexpr std::array<vk::PrimitiveTopology, 3> permutation_topologies = {
+    vk::PrimitiveTopology::eTriangleList,
+    vk::PrimitiveTopology::eTriangleStrip,
+    vk::PrimitiveTopology::eLineList
+};
+constexpr std::array<vk::CullModeFlagBits, 3> permutation_cull_modes = {
+    vk::CullModeFlagBits::eBack,
+    vk::CullModeFlagBits::eFront,
+    vk::CullModeFlagBits::eNone
+};
+constexpr std::array<vk::FrontFace, 2> permutation_front_faces = {
+    vk::FrontFace::eClockwise,
+    vk::FrontFace::eCounterClockwise
+};
+constexpr std::array<BlendMode, 2> permutation_blend_modes = {
+    BlendMode::Opaque,
+    BlendMode::Alpha
+};
+constexpr size_t permutation_count = permutation_topologies.size() * permutation_cull_modes.size()
+                                   * permutation_front_faces.size() * permutation_blend_modes.size();
+
+constexpr auto baked_permutations = [] {
+    std::array<PipelineState, permutation_count> states{};
+    size_t count = 0;
+    for (auto topology : permutation_topologies)
+        for (auto cull_mode : permutation_cull_modes)
+            for (auto front_face : permutation_front_faces)
+                for (auto blend : permutation_blend_modes)
+                    states[count++] = PipelineState {
+                        .topology = topology,
+                        .cull_mode = cull_mode,
+                        .front_face = front_face,
+                        .blend = blend
+                    };
+    return unique_pipeline_states(states);
+}();
+
+constexpr bool all_valid(const UniquePipelineStates<permutation_count>& unique) {
+    for (size_t i = 0; i < unique.count; ++i)
+        if (unique.states[i].error())
+            return false;
+    return true;
+}
+
+static_assert(all_valid(baked_permutations), "Invalid pipeline permutation");
+static_assert(baked_permutations.states[0] == PipelineState{}.normalized(), "The default state must come first");
+// Lines ignore culling and winding, which leaves 2 of their 12 combinations.
+static_assert(baked_permutations.count == 26);
+
+// Has the compiler validate the default state and evaluate its create-info structs, which the
+// runtime builders in create_graphics_pipeline() have to reproduce.
+using DefaultPipelineState = StaticPipelineState<PipelineState{}>;
+static_assert(DefaultPipelineState::state == baked_permutations.states[0]);
+static_assert(DefaultPipelineState::input_assembly.topology == input_assembly_state(PipelineState{}).topology
+           && DefaultPipelineState::rasterization.cullMode == rasterization_state(PipelineState{}).cullMode
+           && DefaultPipelineState::rasterization.frontFace == rasterization_state(PipelineState{}).frontFace
+           && DefaultPipelineState::dynamic.dynamicStateCount == dynamic_state_list(PipelineState{}).count);
+
+// Translucent variants get their alpha through specialization instead of a uniform and a branch.
+constexpr float translucent_alpha = 0.5f;
+
+SpecializationConstants fragment_constants_for(const PipelineState& state) {
+    SpecializationConstants constants;
+    if (state.blend != BlendMode::Opaque)
+        constants.set(fragment_alpha_constant, translucent_alpha);
+    return constants;
+}
+
+const char* blend_name(BlendMode blend) {
+    switch (blend) {
+        case BlendMode::Opaque: return "opaque";
+        case BlendMode::Alpha: return "blend";
+        case BlendMode::Additive: return "additive";
+    }
+    return "unknown";
+}
+
+}
+
+std::string PipelineVariant::describe() const {
+    if (state.dynamic_state)
+        return vk::to_string(state.topology_class()) + " class/dynamic/" + blend_name(state.blend);
+    return vk::to_string(state.topology) + "/cull " + vk::to_string(vk::CullModeFlags(state.cull_mode)) + "/" 
+         + vk::to_string(state.front_face) + "/" + blend_name(state.blend);
+}
+
+uint64_t PipelineVariant::key(uint64_t shaders_hash, vk::RenderPass target_render_pass, vk::Format target_format) const {
+    // Render pass handles may be reused once destroyed, so the format is hashed alongside.
+    return PipelineHash{}
+        .add(shaders_hash)
+        .add(state.hash())
+        .add(std::hash<vk::RenderPass>{}(render_pass ? render_pass : target_render_pass))
+        .add_enum(color_format != vk::Format::eUndefined ? color_format : target_format)
+        .add(vertex_constants.hash())
+        .add(fragment_constants.hash())
+        .value();
+}
+
+std::vector<PipelineVariant> PipelineVariant::permutations() {
+    std::vector<PipelineVariant> variants;
+    for (size_t i = 0; i < baked_permutations.count; ++i) {
+        const PipelineState& state = baked_permutations.states[i];
+        variants.push_back(PipelineVariant {
+            .state = state,
+            .fragment_constants = fragment_constants_for(state)
+        });
+    }
+    return variants;
+}
+
+std::vector<PipelineVariant> PipelineVariant::dynamic_permutations(vk::Format color_format) {
+    // List and strip share a class; lines need their own pipeline.
+    const vk::PrimitiveTopology topology_classes[] = {
+        vk::PrimitiveTopology::eTriangleList,
+        vk::PrimitiveTopology::eLineList
+    };
+
+    std::vector<PipelineVariant> variants;
+    for (auto topology : topology_classes) {
+        for (auto blend : permutation_blend_modes) {
+            PipelineState state {
+                .topology = topology,
+                .blend = blend,
+                .dynamic_state = true
+            };
+            variants.push_back(PipelineVariant {
+                .state = state,
+                .color_format = color_format,
+                .fragment_constants = fragment_constants_for(state)
+            });
+        }
+    }
+    return variants;
+}
+
+void set_default_dynamic_state(const vk::CommandBuffer& cmd) {
+    constexpr PipelineState defaults;
+    cmd.setPrimitiveTopology(defaults.topology);
+    cmd.setCullMode(defaults.cull_mode);
+    cmd.setFrontFace(defaults.front_face);
+    cmd.setDepthTestEnable(static_cast<vk::Bool32>(defaults.depth_test));
+    cmd.setDepthWriteEnable(static_cast<vk::Bool32>(defaults.depth_write));
+    cmd.setDepthCompareOp(defaults.depth_compare);
+}
+
+vk::Pipeline create_graphics_pipeline(const vk::Device& device, const vk::PipelineCache& cache, 
+                                      const PipelineShaders& shaders, const vk::PipelineLayout& layout,
+                                      const vk::RenderPass& render_pass, const PipelineVariant& variant) {
+    if (const char* error = variant.state.error())
+        throw std::runtime_error(std::string("Invalid pipeline state ") + variant.describe() + ": " + error);
+    const PipelineState state = variant.state.normalized();
+
+    std::array<vk::SpecializationMapEntry, SpecializationConstants::max_constants> vertex_entries;
+    std::array<vk::SpecializationMapEntry, SpecializationConstants::max_constants> fragment_entries;
+    vk::SpecializationInfo vertex_specialization = variant.vertex_constants.info(vertex_entries);
+    vk::SpecializationInfo fragment_specialization = variant.fragment_constants.info(fragment_entries);
+    vk::PipelineShaderStageCreateInfo stages[] = {
+        vk::PipelineShaderStageCreateInfo {
+            .stage = vk::ShaderStageFlagBits::eVertex,
+            .module = shaders.vertex,
+            .pName = "main",
+            .pSpecializationInfo = variant.vertex_constants.empty() ? nullptr : &vertex_specialization
+        },
+        vk::PipelineShaderStageCreateInfo {
+            .stage = vk::ShaderStageFlagBits::eFragment,
+            .module = shaders.fragment,
+            .pName = "main",
+            .pSpecializationInfo = variant.fragment_constants.empty() ? nullptr : &fragment_specialization
+        }
+    };
+
+    std::vector<vk::VertexInputBindingDescription> bindings = shaders.vertex_format.bindings();
+    std::vector<vk::VertexInputAttributeDescription> attributes = shaders.vertex_format.attributes();
+    vk::PipelineVertexInputStateCreateInfo vertex_input_create_info {
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size()),
+        .pVertexBindingDescriptions = bindings.data(),
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
+        .pVertexAttributeDescriptions = attributes.data()
+    };
+
+    vk::PipelineViewportStateCreateInfo viewport_create_info {
+        .viewportCount = 1,
+        .scissorCount = 1
+    };
+
+    // The same constexpr builders StaticPipelineState evaluates at compile time.
+    vk::PipelineInputAssemblyStateCreateInfo input_assembly_create_info = input_assembly_state(state);
+    vk::PipelineRasterizationStateCreateInfo rasterization_create_info = rasterization_state(state);
+    vk::PipelineMultisampleStateCreateInfo multisampling_create_info = multisample_state(state);
+    vk::PipelineDepthStencilStateCreateInfo depth_stencil_create_info = depth_stencil_state(state);
+    vk::PipelineColorBlendAttachmentState blend_attach_create_info = color_blend_attachment_state(state);
+    vk::PipelineColorBlendStateCreateInfo blend_state_create_info {
+        .logicOpEnable = static_cast<vk::Bool32>(false),
+        .logicOp = vk::LogicOp::eCopy,
+        .attachmentCount = 1,
+        .pAttachments = &blend_attach_create_info,
+        .blendConstants = std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 0.0f }
+    };
+    DynamicStateList dynamic_states = dynamic_state_list(state);
+    vk::PipelineDynamicStateCreateInfo state_create_info {
+        .dynamicStateCount = dynamic_states.count,
+        .pDynamicStates = dynamic_states.states.data()
+    };
+
+    vk::RenderPass target_render_pass = variant.render_pass ? variant.render_pass : render_pass;
+    vk::PipelineRenderingCreateInfo rendering_create_info {
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &variant.color_format
+    };
+
+    // Only dynamic-state pipelines (whose depth state is dynamic) and depth-tested ones read it.
+    bool uses_depth_state = state.dynamic_state || state.depth_test;
+    vk::GraphicsPipelineCreateInfo pipeline_create_info {
+        .pNext = target_render_pass ? nullptr : &rendering_create_info,
+        .stageCount = 2,
+        .pStages = stages,
+        .pVertexInputState = &vertex_input_create_info,
+        .pInputAssemblyState = &input_assembly_create_info,
+        .pViewportState = &viewport_create_info,
+        .pRasterizationState = &rasterization_create_info,
+        .pMultisampleState = &multisampling_create_info,
+        .pDepthStencilState = uses_depth_state ? &depth_stencil_create_info : nullptr,
+        .pColorBlendState = &blend_state_create_info,
+        .pDynamicState = &state_create_info,
+        .layout = layout,
+        .renderPass = target_render_pass,
+        .subpass = 0,
+        .basePipelineHandle = nullptr,
+        .basePipelineIndex = -1
+    };
+
+    return device.createGraphicsPipeline(cache, pipeline_create_info).value;
+}
+
+PipelineBuilder::PipelineBuilder(const vk::Device& device, const vk::PipelineCache& cache, ThreadPool& pool)
+    : m_device(device), m_cache(cache), m_pool(pool) {
+}
+
+std::vector<PipelineBuildResult> PipelineBuilder::build(const PipelineShaders& shaders, const vk::PipelineLayout& layout,
+                                                        const vk::RenderPass& render_pass, vk::Format color_format,
+                                                        std::span<const PipelineVariant> variants) {
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+
+    std::vector<std::future<PipelineBuildResult>> pending;
+    pending.reserve(variants.size());
+    std::unordered_map<uint64_t, size_t> seen;
+    m_duplicates = 0;
+    for (const auto& variant : variants) {
+        uint64_t key = variant.key(shaders.hash, render_pass, color_format);
+        if (!seen.emplace(key, pending.size()).second) {
+            ++m_duplicates;
+            continue;
+        }
+        pending.push_back(m_pool.submit([this, &shaders, &layout, &render_pass, &variant, key]() {
+            auto compile_start = Clock::now();
+            vk::Pipeline pipeline = create_graphics_pipeline(m_device, m_cache, shaders, layout, render_pass, variant);
+            return PipelineBuildResult { pipeline, key, Clock::now() - compile_start };
+        }));
+    }
+
+    // Collect every future before rethrowing, so no worker still references this frame's locals.
+    std::vector<PipelineBuildResult> results;
+    results.reserve(pending.size());
+    std::exception_ptr error;
+    for (auto& future : pending) {
+        try {
+            results.push_back(future.get());
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+
+    m_wall_time = Clock::now() - start;
+
+    if (error) {
+        for (const auto& result : results)
+            m_device.destroyPipeline(result.pipeline);
+        std::rethrow_exception(error);
+    }
+    return results;
+}
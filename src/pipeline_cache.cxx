@@ -0,0 +1,163 @@
+#include <pipeline_cache.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr uint32_t cache_file_magic = 0x43505456; // "VTPC"
+constexpr uint32_t cache_file_version = 1;
+
+struct CacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_size;
+    uint64_t data_hash;
+    int64_t cold_compile_ns;
+};
+
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::vector<char> read_cache_file(const std::string& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+        return {};
+
+    std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+    if (!file)
+        return {};
+    return buffer;
+}
+
+}
+
+void PipelineCache::load(const std::string& path) {
+    m_path = path;
+    if (!m_path.empty())
+        m_file = read_cache_file(m_path);
+}
+
+void PipelineCache::create(const vk::Device& device, const vk::PhysicalDeviceProperties& properties) {
+    m_device = device;
+    m_properties = properties;
+
+    std::vector<char> blob;
+    m_warm = validate(m_file, blob);
+    m_file = {};
+
+    vk::PipelineCacheCreateInfo cache_create_info {
+        .initialDataSize = m_warm ? blob.size() : 0,
+        .pInitialData = m_warm ? blob.data() : nullptr
+    };
+
+    m_cache = m_device.createPipelineCache(cache_create_info);
+}
+
+bool PipelineCache::validate(const std::vector<char>& file, std::vector<char>& blob) {
+    if (file.size() < sizeof(CacheFileHeader))
+        return false;
+
+    CacheFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != cache_file_magic || header.version != cache_file_version)
+        return false;
+    if (header.data_size != file.size() - sizeof(header))
+        return false;
+
+    const char* data = file.data() + sizeof(header);
+    if (header.data_hash != fnv1a(data, header.data_size)) {
+        std::cerr << "Pipeline cache " << m_path << " is corrupt, ignoring it\n";
+        return false;
+    }
+
+    // The driver's own header decides whether the blob belongs to this device and driver build.
+    VkPipelineCacheHeaderVersionOne driver_header;
+    if (header.data_size < sizeof(driver_header))
+        return false;
+    memcpy(&driver_header, data, sizeof(driver_header));
+
+    if (driver_header.headerSize < sizeof(driver_header)
+        || driver_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        || driver_header.vendorID != m_properties.vendorID
+        || driver_header.deviceID != m_properties.deviceID
+        || memcmp(driver_header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cerr << "Pipeline cache " << m_path << " was written by another device or driver, ignoring it\n";
+        return false;
+    }
+
+    blob.assign(data, data + header.data_size);
+    m_cold_compile_time = std::chrono::nanoseconds(header.cold_compile_ns);
+    return true;
+}
+
+void PipelineCache::save() {
+    if (m_path.empty() || !m_cache) return;
+
+    std::vector<uint8_t> blob = m_device.getPipelineCacheData(m_cache);
+
+    CacheFileHeader header {
+        .magic = cache_file_magic,
+        .version = cache_file_version,
+        .data_size = blob.size(),
+        .data_hash = fnv1a(reinterpret_cast<const char*>(blob.data()), blob.size()),
+        .cold_compile_ns = (m_warm ? m_cold_compile_time : m_compile_time).count()
+    };
+
+    // Write beside the target and rename over it, so a crash never leaves a torn cache behind.
+    std::string tmp_path = m_path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Can't write pipeline cache " << tmp_path << "\n";
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+        file.flush();
+        if (!file) {
+            std::cerr << "Can't write pipeline cache " << tmp_path << "\n";
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, m_path, ec);
+    if (ec) {
+        std::cerr << "Can't replace pipeline cache " << m_path << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmp_path, ec);
+    }
+}
+
+void PipelineCache::destroy() {
+    if (m_cache)
+        m_device.destroyPipelineCache(m_cache);
+    m_cache = nullptr;
+}
+
+void PipelineCache::add_compile_time(std::chrono::nanoseconds elapsed) {
+    m_compile_time += elapsed;
+}
+
+void PipelineCache::report() const {
+    using ms = std::chrono::duration<double, std::milli>;
+
+    std::cout << "Pipeline compile: " << ms(m_compile_time).count() << " ms";
+    if (m_warm) {
+        std::cout << " (warm, cold start took " << ms(m_cold_compile_time).count() 
+                  << " ms, saved " << ms(m_cold_compile_time - m_compile_time).count() << " ms)";
+    } else {
+        std::cout << " (cold)";
+    }
+    std::cout << "\n";
+}
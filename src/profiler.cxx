@@ -0,0 +1,291 @@
+#include <profiler.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace {
+
+constexpr uint32_t queries_per_frame = 128;
+constexpr size_t max_events = 1 << 20;
+constexpr size_t frame_time_window = 1000;
+
+constexpr vk::QueryPipelineStatisticFlags statistic_flags = vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices
+                                                          | vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives
+                                                          | vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+                                                          | vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+                                                          | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+
+}
+
+CpuScope::CpuScope(Profiler& profiler, const char* name)
+    : m_profiler(profiler), m_name(name), m_start(std::chrono::steady_clock::now()) {
+}
+
+CpuScope::~CpuScope() {
+    auto end = std::chrono::steady_clock::now();
+    m_profiler.record_event(Profiler::Event {
+        .name = m_name,
+        .start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - m_profiler.m_epoch).count(),
+        .duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count(),
+        .thread = m_profiler.thread_index(),
+        .gpu = false
+    });
+}
+
+GpuScope::GpuScope(Profiler& profiler, const vk::CommandBuffer& cmd, const char* name)
+    : m_profiler(profiler), m_cmd(cmd), m_zone(profiler.begin_zone(cmd, name)) {
+}
+
+GpuScope::~GpuScope() {
+    m_profiler.end_zone(m_cmd, m_zone);
+}
+
+Profiler::Profiler()
+    : m_epoch(std::chrono::steady_clock::now()) {
+}
+
+int64_t Profiler::now_ns() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+uint32_t Profiler::thread_index() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto id = std::this_thread::get_id();
+    auto it = std::find(m_threads.begin(), m_threads.end(), id);
+    if (it != m_threads.end())
+        return static_cast<uint32_t>(it - m_threads.begin());
+    m_threads.push_back(id);
+    return static_cast<uint32_t>(m_threads.size() - 1);
+}
+
+void Profiler::record_event(const Event& event) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_events.size() < max_events)
+        m_events.push_back(event);
+}
+
+void Profiler::init_gpu(const vk::Device& device, const DeviceCapabilities& caps, const vk::Queue& queue,
+                        uint32_t queue_family, uint32_t frames_in_flight, bool pipeline_statistics) {
+    m_device = device;
+    m_frames.assign(frames_in_flight, FrameQueries{});
+
+    const vk::PhysicalDeviceLimits& limits = caps.properties.limits;
+    uint32_t valid_bits = caps.queue_family_properties[queue_family].timestampValidBits;
+    if (!limits.timestampComputeAndGraphics || valid_bits == 0)
+        return;
+
+    m_timestamp_period = limits.timestampPeriod;
+    m_timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    m_timestamp_pool = m_device.createQueryPool(vk::QueryPoolCreateInfo {
+        .queryType = vk::QueryType::eTimestamp,
+        .queryCount = queries_per_frame * frames_in_flight
+    });
+
+    if (pipeline_statistics) {
+        m_statistics_pool = m_device.createQueryPool(vk::QueryPoolCreateInfo {
+            .queryType = vk::QueryType::ePipelineStatistics,
+            .queryCount = frames_in_flight,
+            .pipelineStatistics = statistic_flags
+        });
+    }
+
+    calibrate(queue, queue_family);
+}
+
+void Profiler::calibrate(const vk::Queue& queue, uint32_t queue_family) {
+    vk::CommandPool pool = m_device.createCommandPool(vk::CommandPoolCreateInfo {
+        .flags = vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = queue_family
+    });
+    vk::CommandBuffer cmd = m_device.allocateCommandBuffers(vk::CommandBufferAllocateInfo {
+        .commandPool = pool,
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1
+    }).front();
+
+    cmd.begin(vk::CommandBufferBeginInfo { .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    cmd.resetQueryPool(m_timestamp_pool, 0, 1);
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_timestamp_pool, 0);
+    cmd.end();
+
+    vk::Fence fence = m_device.createFence(vk::FenceCreateInfo{});
+    int64_t cpu_before = now_ns();
+    queue.submit(vk::SubmitInfo { .commandBufferCount = 1, .pCommandBuffers = &cmd }, fence);
+    vk::Result result = m_device.waitForFences(fence, true, UINT64_MAX);
+    int64_t cpu_after = now_ns();
+
+    uint64_t timestamp = 0;
+    if (result == vk::Result::eSuccess
+        && m_device.getQueryPoolResults(m_timestamp_pool, 0, 1, sizeof(timestamp), &timestamp, sizeof(uint64_t),
+                                        vk::QueryResultFlagBits::e64) == vk::Result::eSuccess) {
+        // The timestamp landed somewhere inside the submit round trip; the midpoint is the best guess.
+        int64_t gpu_ns = static_cast<int64_t>((timestamp & m_timestamp_mask) * m_timestamp_period);
+        m_gpu_offset_ns = (cpu_before + cpu_after) / 2 - gpu_ns;
+    }
+
+    m_device.destroyFence(fence);
+    m_device.destroyCommandPool(pool);
+}
+
+void Profiler::destroy() {
+    if (m_timestamp_pool)
+        m_device.destroyQueryPool(m_timestamp_pool);
+    if (m_statistics_pool)
+        m_device.destroyQueryPool(m_statistics_pool);
+    m_timestamp_pool = nullptr;
+    m_statistics_pool = nullptr;
+}
+
+void Profiler::begin_frame(const vk::CommandBuffer& cmd, uint32_t frame_index) {
+    m_current_frame = frame_index;
+    FrameQueries& frame = m_frames[frame_index];
+    frame.zones.clear();
+    frame.used = 0;
+    frame.submitted = true;
+
+    if (m_timestamp_pool)
+        cmd.resetQueryPool(m_timestamp_pool, frame_index * queries_per_frame, queries_per_frame);
+    if (m_statistics_pool) {
+        cmd.resetQueryPool(m_statistics_pool, frame_index, 1);
+        cmd.beginQuery(m_statistics_pool, frame_index, vk::QueryControlFlags{});
+    }
+
+    m_frame_zone = begin_zone(cmd, "frame");
+}
+
+void Profiler::end_frame(const vk::CommandBuffer& cmd) {
+    end_zone(cmd, m_frame_zone);
+    m_frame_zone = -1;
+    if (m_statistics_pool)
+        cmd.endQuery(m_statistics_pool, m_current_frame);
+}
+
+int32_t Profiler::begin_zone(const vk::CommandBuffer& cmd, const char* name) {
+    if (!m_timestamp_pool) return -1;
+
+    FrameQueries& frame = m_frames[m_current_frame];
+    if (frame.used + 2 > queries_per_frame) return -1;
+
+    uint32_t first = m_current_frame * queries_per_frame + frame.used;
+    frame.used += 2;
+    frame.zones.push_back(GpuZone { .name = name, .begin_query = first, .end_query = first + 1 });
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_timestamp_pool, first);
+    return static_cast<int32_t>(frame.zones.size() - 1);
+}
+
+void Profiler::end_zone(const vk::CommandBuffer& cmd, int32_t zone) {
+    if (zone < 0) return;
+    const GpuZone& gpu_zone = m_frames[m_current_frame].zones[zone];
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_timestamp_pool, gpu_zone.end_query);
+}
+
+double Profiler::collect(uint32_t frame_index) {
+    FrameQueries& frame = m_frames[frame_index];
+    if (!frame.submitted || !m_timestamp_pool || frame.used == 0)
+        return 0.0;
+    frame.submitted = false;
+
+    std::vector<uint64_t> timestamps(frame.used);
+    vk::Result result = m_device.getQueryPoolResults(m_timestamp_pool, frame_index * queries_per_frame, frame.used,
+                                                     timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                                                     sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess)
+        return 0.0;
+
+    uint32_t base = frame_index * queries_per_frame;
+    double frame_ms = 0.0;
+    for (const auto& zone : frame.zones) {
+        uint64_t begin = timestamps[zone.begin_query - base] & m_timestamp_mask;
+        uint64_t end = timestamps[zone.end_query - base] & m_timestamp_mask;
+        int64_t duration_ns = static_cast<int64_t>((end - begin) * m_timestamp_period);
+
+        record_event(Event {
+            .name = zone.name,
+            .start_ns = static_cast<int64_t>(begin * m_timestamp_period) + m_gpu_offset_ns,
+            .duration_ns = duration_ns,
+            .thread = 0,
+            .gpu = true
+        });
+        if (&zone == &frame.zones.front())
+            frame_ms = duration_ns / 1e6;
+    }
+
+    if (m_statistics_pool) {
+        uint64_t values[5];
+        if (m_device.getQueryPoolResults(m_statistics_pool, frame_index, 1, sizeof(values), values, sizeof(values),
+                                         vk::QueryResultFlagBits::e64) == vk::Result::eSuccess) {
+            // Results come in flag-bit order.
+            m_last_statistics = PipelineStatistics {
+                .input_vertices = values[0],
+                .input_primitives = values[1],
+                .vertex_invocations = values[2],
+                .clipping_primitives = values[3],
+                .fragment_invocations = values[4]
+            };
+        }
+    }
+
+    return frame_ms;
+}
+
+void Profiler::add_frame_time(double ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frame_times.push_back(ms);
+    if (m_frame_times.size() > frame_time_window)
+        m_frame_times.pop_front();
+}
+
+FrameTimeStats Profiler::frame_time_stats() const {
+    std::vector<double> samples;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        samples.assign(m_frame_times.begin(), m_frame_times.end());
+    }
+    return summarize_frame_times(std::move(samples));
+}
+
+FrameTimeStats summarize_frame_times(std::vector<double> samples) {
+    if (samples.empty())
+        return {};
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double ms : samples)
+        sum += ms;
+
+    auto percentile = [&](double p) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p * (samples.size() - 1) + 0.5))];
+    };
+
+    return FrameTimeStats {
+        .mean_ms = sum / samples.size(),
+        .p50_ms = percentile(0.50),
+        .p99_ms = percentile(0.99),
+        .max_ms = samples.back(),
+        .samples = samples.size()
+    };
+}
+
+bool Profiler::write_chrome_trace(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    // Microseconds with nanosecond resolution; the default precision rounds anything past a second.
+    file << std::fixed << std::setprecision(3);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+    for (const auto& event : m_events) {
+        file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\""
+             << ",\"ts\":" << event.start_ns / 1000.0
+             << ",\"dur\":" << event.duration_ns / 1000.0
+             << ",\"pid\":" << (event.gpu ? 1 : 0)
+             << ",\"tid\":" << event.thread << "}";
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,369 @@
+#include <readback.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr vk::DeviceSize texel_size = 4;
+
+vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool is_bgra(vk::Format format) {
+    return format == vk::Format::eB8G8R8A8Unorm || format == vk::Format::eB8G8R8A8Srgb;
+}
+
+// Swizzles one row of 4-byte texels into 8-bit RGB.
+void to_rgb(const std::byte* texels, uint32_t width, bool bgra, std::vector<char>& row) {
+    row.resize(size_t(width) * 3);
+    for (uint32_t x = 0; x < width; ++x) {
+        const std::byte* texel = texels + size_t(x) * texel_size;
+        row[x * 3 + 0] = static_cast<char>(texel[bgra ? 2 : 0]);
+        row[x * 3 + 1] = static_cast<char>(texel[1]);
+        row[x * 3 + 2] = static_cast<char>(texel[bgra ? 0 : 2]);
+    }
+}
+
+const std::array<uint32_t, 256>& crc_table() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+    return table;
+}
+
+// Streams PNG chunks, keeping the running CRC of the current one.
+class PngStream {
+public:
+    explicit PngStream(std::ofstream& out) : m_out(out) {}
+
+    void begin_chunk(const char* type, uint32_t length) {
+        write_u32(length);
+        m_crc = 0xffffffffu;
+        write(type, 4);
+    }
+    void end_chunk() {
+        uint32_t crc = m_crc ^ 0xffffffffu;
+        write_u32(crc);
+    }
+    void write(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+            m_crc = crc_table()[(m_crc ^ bytes[i]) & 0xff] ^ (m_crc >> 8);
+        m_out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+    void write_u32(uint32_t value) {
+        uint8_t bytes[4] = { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) };
+        write(bytes, 4);
+    }
+
+private:
+    std::ofstream& m_out;
+    uint32_t m_crc = 0;
+};
+
+// Zlib stream of stored (uncompressed) deflate blocks, fed row by row. The total length is
+// known up front, so the block boundaries are too.
+class StoredDeflate {
+public:
+    static constexpr uint32_t max_block = 65535;
+
+    StoredDeflate(PngStream& png, uint64_t total) : m_png(png), m_remaining(total) {}
+
+    static uint32_t encoded_size(uint64_t total) {
+        uint64_t blocks = std::max<uint64_t>(1, (total + max_block - 1) / max_block);
+        return static_cast<uint32_t>(2 + total + 5 * blocks + 4);
+    }
+
+    void begin() {
+        const uint8_t header[2] = { 0x78, 0x01 };
+        m_png.write(header, 2);
+    }
+    void write(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            if (m_block_left == 0)
+                begin_block();
+            size_t n = std::min<size_t>(size, m_block_left);
+            m_png.write(bytes, n);
+            for (size_t i = 0; i < n; ++i) {
+                m_a = (m_a + bytes[i]) % 65521;
+                m_b = (m_b + m_a) % 65521;
+            }
+            m_block_left -= static_cast<uint32_t>(n);
+            m_remaining -= n;
+            bytes += n;
+            size -= n;
+        }
+    }
+    void end() {
+        m_png.write_u32((m_b << 16) | m_a);
+    }
+
+private:
+    void begin_block() {
+        uint16_t length = static_cast<uint16_t>(std::min<uint64_t>(m_remaining, max_block));
+        uint16_t inverse = static_cast<uint16_t>(~length);
+        const uint8_t header[5] = {
+            uint8_t(m_remaining <= max_block ? 1 : 0),
+            uint8_t(length), uint8_t(length >> 8),
+            uint8_t(inverse), uint8_t(inverse >> 8)
+        };
+        m_png.write(header, 5);
+        m_block_left = length;
+    }
+
+    PngStream& m_png;
+    uint64_t m_remaining;
+    uint32_t m_block_left = 0;
+    uint32_t m_a = 1;
+    uint32_t m_b = 0;
+};
+
+void write_png(std::ofstream& out, const ReadbackFrame& frame) {
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    PngStream png(out);
+    png.begin_chunk("IHDR", 13);
+    png.write_u32(frame.extent.width);
+    png.write_u32(frame.extent.height);
+    // 8-bit RGB, deflate, adaptive filtering (every row uses filter 0), no interlacing.
+    const uint8_t format[5] = { 8, 2, 0, 0, 0 };
+    png.write(format, sizeof(format));
+    png.end_chunk();
+
+    uint64_t row_bytes = 1 + uint64_t(frame.extent.width) * 3;
+    uint64_t total = row_bytes * frame.extent.height;
+    png.begin_chunk("IDAT", StoredDeflate::encoded_size(total));
+    StoredDeflate deflate(png, total);
+    deflate.begin();
+    std::vector<char> row;
+    bool bgra = is_bgra(frame.format);
+    for (uint32_t y = 0; y < frame.extent.height; ++y) {
+        const char filter = 0;
+        deflate.write(&filter, 1);
+        to_rgb(frame.pixels.data() + size_t(y) * frame.extent.width * texel_size, frame.extent.width, bgra, row);
+        deflate.write(row.data(), row.size());
+    }
+    deflate.end();
+    png.end_chunk();
+
+    png.begin_chunk("IEND", 0);
+    png.end_chunk();
+}
+
+}
+
+bool FrameReadback::supports(vk::Format format) {
+    return is_bgra(format) || format == vk::Format::eR8G8B8A8Unorm || format == vk::Format::eR8G8B8A8Srgb;
+}
+
+void FrameReadback::init(const vk::Device& device, const vk::PhysicalDeviceLimits& limits, GpuAllocator& allocator,
+                         TaskScheduler& tasks, uint32_t frames_in_flight, uint32_t latency, ReadbackConsumer consumer) {
+    m_device = device;
+    m_allocator = &allocator;
+    m_tasks = &tasks;
+    m_consumer = std::move(consumer);
+    m_slots = std::vector<Slot>(frames_in_flight + std::max(latency, 1u));
+    m_atom_size = limits.nonCoherentAtomSize;
+
+    // Host-cached memory makes the consumer's reads fast, at the price of invalidating it first.
+    m_memory_properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached;
+    m_coherent = false;
+    const auto& memory = allocator.memory_properties();
+    bool cached = false;
+    for (uint32_t i = 0; i < memory.memoryTypeCount; ++i)
+        cached = cached || (memory.memoryTypes[i].propertyFlags & m_memory_properties) == m_memory_properties;
+    if (!cached) {
+        m_memory_properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        m_coherent = true;
+    }
+}
+
+void FrameReadback::destroy() {
+    for (Slot& slot : m_slots) {
+        if (slot.consumed.valid())
+            slot.consumed.wait();
+        if (slot.buffer.buffer)
+            m_allocator->destroy_buffer(slot.buffer);
+    }
+    m_slots.clear();
+    m_consumer = nullptr;
+}
+
+void FrameReadback::record(const vk::CommandBuffer& cmd, vk::Image image, vk::ImageLayout layout,
+                           vk::Extent2D extent, vk::Format format, uint64_t frame_number) {
+    Slot& slot = m_slots[frame_number % m_slots.size()];
+    // The frame that used this slot before is at least frames_in_flight old, so the GPU is done
+    // with it; the consumer may not be. Rethrows what the consumer threw.
+    if (slot.consumed.valid())
+        slot.consumed.get();
+
+    vk::DeviceSize size = align_up(vk::DeviceSize(extent.width) * extent.height * texel_size, m_atom_size);
+    if (slot.size < size) {
+        if (slot.buffer.buffer)
+            m_allocator->destroy_buffer(slot.buffer);
+
+        // Allocated by hand so the range is aligned to nonCoherentAtomSize for invalidation.
+        slot.buffer.buffer = m_device.createBuffer(vk::BufferCreateInfo {
+            .size = size,
+            .usage = vk::BufferUsageFlagBits::eTransferDst,
+            .sharingMode = vk::SharingMode::eExclusive
+        });
+        vk::MemoryRequirements requirements = m_device.getBufferMemoryRequirements(slot.buffer.buffer);
+        requirements.alignment = std::max(requirements.alignment, m_atom_size);
+        requirements.size = align_up(requirements.size, m_atom_size);
+        slot.buffer.allocation = m_allocator->allocate(requirements, m_memory_properties, ResourceKind::Linear);
+        m_device.bindBufferMemory(slot.buffer.buffer, slot.buffer.allocation.memory, slot.buffer.allocation.offset);
+        slot.size = size;
+    }
+
+    vk::ImageSubresourceRange range {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+    bool transition = layout != vk::ImageLayout::eTransferSrcOptimal;
+    if (transition) {
+        vk::ImageMemoryBarrier to_transfer {
+            .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+            .oldLayout = layout,
+            .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = range
+        };
+        // Transfer in the source scope chains with a render pass's dependency into the transfer
+        // stage, which is what orders its final layout transition before this one.
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer,
+                            vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{}, nullptr, nullptr, to_transfer);
+    }
+
+    cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slot.buffer.buffer, vk::BufferImageCopy {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = vk::ImageSubresourceLayers {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .imageOffset = vk::Offset3D { 0, 0, 0 },
+        .imageExtent = vk::Extent3D { extent.width, extent.height, 1 }
+    });
+
+    if (transition) {
+        vk::ImageMemoryBarrier restore {
+            .srcAccessMask = vk::AccessFlags{},
+            .dstAccessMask = vk::AccessFlags{},
+            .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+            .newLayout = layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = image,
+            .subresourceRange = range
+        };
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+                            vk::DependencyFlags{}, nullptr, nullptr, restore);
+    }
+
+    vk::MemoryBarrier to_host {
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eHostRead
+    };
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+                        vk::DependencyFlags{}, to_host, nullptr, nullptr);
+
+    slot.pending = true;
+    slot.frame_number = frame_number;
+    slot.extent = extent;
+    slot.format = format;
+}
+
+void FrameReadback::submitted(uint64_t frame_number, TimelinePoint completion) {
+    if (!enabled()) return;
+
+    Slot& slot = m_slots[frame_number % m_slots.size()];
+    if (!slot.pending || slot.frame_number != frame_number)
+        return;
+    slot.pending = false;
+    slot.consumed = m_tasks->spawn(deliver(slot, completion));
+}
+
+void FrameReadback::flush() {
+    for (Slot& slot : m_slots) {
+        // Recorded into a frame that never got submitted; there is nothing to deliver.
+        slot.pending = false;
+        if (slot.consumed.valid())
+            slot.consumed.get();
+    }
+}
+
+Task<> FrameReadback::deliver(Slot& slot, TimelinePoint completion) {
+    co_await m_tasks->wait(completion);
+
+    const Allocation& allocation = slot.buffer.allocation;
+    if (!m_coherent) {
+        m_device.invalidateMappedMemoryRanges(vk::MappedMemoryRange {
+            .memory = allocation.memory,
+            .offset = allocation.offset,
+            .size = slot.size
+        });
+    }
+
+    ReadbackFrame frame {
+        .frame_number = slot.frame_number,
+        .extent = slot.extent,
+        .format = slot.format,
+        .pixels = std::span<const std::byte>(static_cast<const std::byte*>(allocation.mapped),
+                                             size_t(slot.extent.width) * slot.extent.height * texel_size)
+    };
+    m_consumer(frame);
+    ++m_delivered;
+}
+
+void FrameFileWriter::operator()(const ReadbackFrame& frame) const {
+    static constexpr const char* extensions[] = { "raw", "ppm", "png" };
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%06llu.%s", static_cast<unsigned long long>(frame.frame_number),
+                  extensions[static_cast<int>(m_format)]);
+
+    std::ofstream out(m_prefix + suffix, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Can't write " + m_prefix + suffix);
+
+    switch (m_format) {
+    case ReadbackFileFormat::Raw:
+        out.write(reinterpret_cast<const char*>(frame.pixels.data()), static_cast<std::streamsize>(frame.pixels.size()));
+        break;
+    case ReadbackFileFormat::Ppm: {
+        out << "P6\n" << frame.extent.width << " " << frame.extent.height << "\n255\n";
+        std::vector<char> row;
+        bool bgra = is_bgra(frame.format);
+        for (uint32_t y = 0; y < frame.extent.height; ++y) {
+            to_rgb(frame.pixels.data() + size_t(y) * frame.extent.width * texel_size, frame.extent.width, bgra, row);
+            out.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+        break;
+    }
+    case ReadbackFileFormat::Png:
+        write_png(out, frame);
+        break;
+    }
+}
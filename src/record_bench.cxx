@@ -0,0 +1,50 @@
+#include <application.hpp>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Renders the same headless workload with an increasing number of recording threads and reports
+// how the per-frame recording time scales. Usage: record_bench [draws] [frames]
+int main(int argc, char** argv) {
+    uint32_t draws = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 20000;
+    uint32_t frames = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 300;
+
+    std::vector<uint32_t> thread_counts = { 0 };
+    uint32_t hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t threads = 1; threads <= hardware_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    if (thread_counts.back() != hardware_threads)
+        thread_counts.push_back(hardware_threads);
+
+    double inline_record_ms = 0.0;
+    std::cout << "threads,record_ms,cpu_ms,fps,speedup\n";
+    for (uint32_t threads : thread_counts) {
+        ApplicationConfig config;
+        config.headless = true;
+        config.use_headless_surface = false;
+        config.max_frames = frames;
+        config.instance_count = draws;
+        config.draw_count = draws;
+        config.record_threads = threads;
+        config.pipeline_cache_path.clear();
+
+        Application app(config);
+        try {
+            app.run();
+        } catch (std::exception& e) {
+            std::cout << e.what() << '\n';
+            return EXIT_FAILURE;
+        }
+
+        const FrameStats& stats = app.run_stats();
+        if (threads == 0)
+            inline_record_ms = stats.record_ms;
+
+        std::cout << threads << "," << stats.record_ms << "," << stats.cpu_ms << "," << stats.fps << ","
+                  << (stats.record_ms > 0.0 ? inline_record_ms / stats.record_ms : 0.0) << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
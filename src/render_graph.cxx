@@ -0,0 +1,462 @@
+#include <render_graph.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+struct AccessInfo {
+    vk::PipelineStageFlags2 stages;
+    vk::AccessFlags2 access;
+    vk::ImageLayout layout;
+    bool write;
+};
+
+AccessInfo describe(ResourceAccess access) {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    using Layout = vk::ImageLayout;
+    switch (access) {
+    case ResourceAccess::ColorAttachmentWrite:
+        return { Stage::eColorAttachmentOutput, Access::eColorAttachmentWrite | Access::eColorAttachmentRead,
+                 Layout::eColorAttachmentOptimal, true };
+    case ResourceAccess::DepthAttachmentWrite:
+        return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+                 Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite,
+                 Layout::eDepthStencilAttachmentOptimal, true };
+    case ResourceAccess::DepthAttachmentRead:
+        return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead,
+                 Layout::eDepthStencilReadOnlyOptimal, false };
+    case ResourceAccess::FragmentSampledRead:
+        return { Stage::eFragmentShader, Access::eShaderSampledRead, Layout::eShaderReadOnlyOptimal, false };
+    case ResourceAccess::ComputeSampledRead:
+        return { Stage::eComputeShader, Access::eShaderSampledRead, Layout::eShaderReadOnlyOptimal, false };
+    case ResourceAccess::ComputeStorageRead:
+        return { Stage::eComputeShader, Access::eShaderStorageRead, Layout::eGeneral, false };
+    case ResourceAccess::ComputeStorageWrite:
+        return { Stage::eComputeShader, Access::eShaderStorageRead | Access::eShaderStorageWrite, Layout::eGeneral, true };
+    case ResourceAccess::IndirectRead:
+        return { Stage::eDrawIndirect, Access::eIndirectCommandRead, Layout::eUndefined, false };
+    case ResourceAccess::TransferRead:
+        return { Stage::eTransfer, Access::eTransferRead, Layout::eTransferSrcOptimal, false };
+    case ResourceAccess::TransferWrite:
+        return { Stage::eTransfer, Access::eTransferWrite, Layout::eTransferDstOptimal, true };
+    case ResourceAccess::Present:
+        return { Stage::eNone, Access::eNone, Layout::ePresentSrcKHR, false };
+    }
+    throw std::runtime_error("Unknown resource access");
+}
+
+// What the graph knows about a resource between two accesses.
+struct ResourceState {
+    vk::PipelineStageFlags2 write_stages;
+    vk::AccessFlags2 write_access;
+    // Reads since the last write, which a following write has to wait for.
+    vk::PipelineStageFlags2 read_stages;
+    // Where the last write has already been made visible.
+    vk::PipelineStageFlags2 visible_stages;
+    vk::AccessFlags2 visible_access;
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+};
+
+template <typename Flags>
+bool covers(Flags have, Flags want) {
+    return (have & want) == want;
+}
+
+vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(ResourceId resource, ResourceAccess access) {
+    if (describe(access).write)
+        throw std::runtime_error("Pass " + m_graph.m_passes[m_pass].name + " reads with a write access");
+    m_graph.m_passes[m_pass].uses.push_back(Use { resource, access });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(ResourceId resource, ResourceAccess access) {
+    if (!describe(access).write)
+        throw std::runtime_error("Pass " + m_graph.m_passes[m_pass].name + " writes with a read access");
+    m_graph.m_passes[m_pass].uses.push_back(Use { resource, access });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::side_effect() {
+    m_graph.m_passes[m_pass].side_effect = true;
+    return *this;
+}
+
+RenderGraph::ResourceId RenderGraph::import_image(std::string name, vk::PipelineStageFlags2 wait_stage, ResourceAccess final_access) {
+    m_resources.push_back(Resource {
+        .name = std::move(name),
+        .is_image = true,
+        .imported = true,
+        .wait_stage = wait_stage,
+        .final_access = final_access
+    });
+    return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::import_buffer(std::string name) {
+    m_resources.push_back(Resource {
+        .name = std::move(name),
+        .is_image = false,
+        .imported = true
+    });
+    return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::create_image(std::string name, const TransientImageDesc& desc) {
+    m_resources.push_back(Resource {
+        .name = std::move(name),
+        .is_image = true,
+        .imported = false,
+        .desc = desc
+    });
+    return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::add_pass(std::string name, Execute execute) {
+    m_passes.push_back(Pass {
+        .name = std::move(name),
+        .execute = std::move(execute)
+    });
+    return PassBuilder(*this, static_cast<uint32_t>(m_passes.size() - 1));
+}
+
+void RenderGraph::compile(const vk::Device& device, GpuAllocator& allocator) {
+    m_device = device;
+    m_stats = RenderGraphStats { .passes = static_cast<uint32_t>(m_passes.size()) };
+
+    for (const Pass& pass : m_passes) {
+        std::vector<ResourceId> seen;
+        for (const Use& use : pass.uses) {
+            if (std::find(seen.begin(), seen.end(), use.resource) != seen.end())
+                throw std::runtime_error("Pass " + pass.name + " accesses " + m_resources[use.resource].name + " twice");
+            seen.push_back(use.resource);
+        }
+    }
+
+    cull_passes();
+    allocate_transients(allocator);
+    plan_barriers();
+}
+
+// Walks backwards from the imported resources: a pass survives if it writes something that is
+// imported or read by a pass that survived.
+void RenderGraph::cull_passes() {
+    std::vector<bool> needed(m_resources.size());
+    for (size_t i = 0; i < m_resources.size(); ++i)
+        needed[i] = m_resources[i].imported;
+
+    for (size_t p = m_passes.size(); p-- > 0;) {
+        Pass& pass = m_passes[p];
+        pass.live = pass.side_effect || std::any_of(pass.uses.begin(), pass.uses.end(), [&](const Use& use) {
+            return describe(use.access).write && needed[use.resource];
+        });
+        if (!pass.live) {
+            ++m_stats.culled_passes;
+            continue;
+        }
+        for (const Use& use : pass.uses) {
+            if (!describe(use.access).write)
+                needed[use.resource] = true;
+        }
+    }
+}
+
+// Transients are placed largest first into the first memory slot whose occupants' lifetimes
+// (first to last live pass) do not overlap theirs; otherwise they open a new slot. Every slot
+// lives in one shared allocation.
+void RenderGraph::allocate_transients(GpuAllocator& allocator) {
+    struct Lifetime {
+        ResourceId resource;
+        uint32_t first;
+        uint32_t last;
+        vk::MemoryRequirements requirements;
+    };
+
+    std::vector<Lifetime> lifetimes;
+    for (ResourceId r = 0; r < m_resources.size(); ++r) {
+        if (m_resources[r].imported) continue;
+
+        Lifetime lifetime { .resource = r, .first = ~0u, .last = 0 };
+        for (uint32_t p = 0; p < m_passes.size(); ++p) {
+            if (!m_passes[p].live) continue;
+            for (const Use& use : m_passes[p].uses) {
+                if (use.resource != r) continue;
+                lifetime.first = std::min(lifetime.first, p);
+                lifetime.last = std::max(lifetime.last, p);
+            }
+        }
+        if (lifetime.first == ~0u) continue;
+
+        Resource& resource = m_resources[r];
+        resource.image = m_device.createImage(vk::ImageCreateInfo {
+            .imageType = vk::ImageType::e2D,
+            .format = resource.desc.format,
+            .extent = vk::Extent3D { resource.desc.extent.width, resource.desc.extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = vk::SampleCountFlagBits::e1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = resource.desc.usage,
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined
+        });
+        lifetime.requirements = m_device.getImageMemoryRequirements(resource.image);
+        lifetimes.push_back(lifetime);
+    }
+    if (lifetimes.empty()) return;
+
+    std::sort(lifetimes.begin(), lifetimes.end(), [](const Lifetime& a, const Lifetime& b) {
+        return a.requirements.size > b.requirements.size;
+    });
+
+    vk::DeviceSize alignment = 1;
+    uint32_t memory_type_bits = ~0u;
+    for (const Lifetime& lifetime : lifetimes) {
+        alignment = std::max(alignment, lifetime.requirements.alignment);
+        memory_type_bits &= lifetime.requirements.memoryTypeBits;
+        m_stats.unaliased_bytes += lifetime.requirements.size;
+    }
+    if (memory_type_bits == 0)
+        throw std::runtime_error("Transient images have no memory type in common");
+
+    struct Slot {
+        vk::DeviceSize offset;
+        vk::DeviceSize size;
+        std::vector<const Lifetime*> occupants;
+    };
+    std::vector<Slot> slots;
+    vk::DeviceSize total = 0;
+    for (const Lifetime& lifetime : lifetimes) {
+        auto fits = [&lifetime](const Slot& slot) {
+            return slot.size >= lifetime.requirements.size
+                && std::none_of(slot.occupants.begin(), slot.occupants.end(), [&lifetime](const Lifetime* other) {
+                       return lifetime.first <= other->last && other->first <= lifetime.last;
+                   });
+        };
+        auto slot = std::find_if(slots.begin(), slots.end(), fits);
+        if (slot == slots.end()) {
+            total = align_up(total, alignment);
+            slots.push_back(Slot { .offset = total, .size = lifetime.requirements.size });
+            total += lifetime.requirements.size;
+            slot = slots.end() - 1;
+        }
+        slot->occupants.push_back(&lifetime);
+        m_resources[lifetime.resource].memory_offset = slot->offset;
+    }
+
+    m_transient_memory = allocator.allocate(vk::MemoryRequirements {
+        .size = total,
+        .alignment = alignment,
+        .memoryTypeBits = memory_type_bits
+    }, vk::MemoryPropertyFlagBits::eDeviceLocal, ResourceKind::Optimal);
+    m_stats.transient_bytes = total;
+
+    for (const Lifetime& lifetime : lifetimes) {
+        Resource& resource = m_resources[lifetime.resource];
+        m_device.bindImageMemory(resource.image, m_transient_memory.memory, m_transient_memory.offset + resource.memory_offset);
+        resource.view = m_device.createImageView(vk::ImageViewCreateInfo {
+            .image = resource.image,
+            .viewType = vk::ImageViewType::e2D,
+            .format = resource.desc.format,
+            .subresourceRange = vk::ImageSubresourceRange {
+                .aspectMask = resource.desc.aspect,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        });
+    }
+}
+
+// Simulates one execution to learn the state every resource is left in, then plans the real
+// barriers starting from that state: buffers carry their state over from the previous frame,
+// transients inherit the hazards of whatever last used their memory.
+void RenderGraph::plan_barriers() {
+    auto initial_state = [this](const std::vector<ResourceState>& previous_end) {
+        std::vector<ResourceState> states(m_resources.size());
+        for (ResourceId r = 0; r < m_resources.size(); ++r) {
+            const Resource& resource = m_resources[r];
+            if (!resource.is_image) {
+                states[r] = previous_end[r];
+            } else if (resource.imported) {
+                states[r].write_stages = resource.wait_stage;
+                states[r].read_stages = describe(resource.final_access).stages;
+            } else {
+                // Any transient sharing the memory, including this one from the previous frame.
+                for (ResourceId other = 0; other < m_resources.size(); ++other) {
+                    const Resource& alias = m_resources[other];
+                    if (alias.imported || !alias.image || alias.memory_offset != resource.memory_offset) continue;
+                    states[r].write_stages |= previous_end[other].write_stages | previous_end[other].read_stages;
+                    states[r].write_access |= previous_end[other].write_access;
+                }
+            }
+        }
+        return states;
+    };
+
+    auto simulate = [this](std::vector<ResourceState>& states, bool emit) {
+        for (Pass& pass : m_passes) {
+            if (!pass.live) continue;
+            for (const Use& use : pass.uses) {
+                const Resource& resource = m_resources[use.resource];
+                ResourceState& state = states[use.resource];
+                AccessInfo info = describe(use.access);
+                vk::ImageLayout layout = resource.is_image ? info.layout : vk::ImageLayout::eUndefined;
+                bool layout_change = layout != state.layout;
+
+                if (!resource.imported && resource.is_image && state.layout == vk::ImageLayout::eUndefined && !info.write)
+                    throw std::runtime_error("Pass " + pass.name + " reads " + resource.name + " before anything writes it");
+
+                Barrier barrier {
+                    .resource = use.resource,
+                    .dst_stages = info.stages,
+                    .dst_access = info.access,
+                    .old_layout = state.layout,
+                    .new_layout = layout
+                };
+                if (info.write || layout_change) {
+                    // Writes and transitions wait for everything since the last write.
+                    barrier.src_stages = state.write_stages | state.read_stages;
+                    barrier.src_access = state.write_access;
+                    state.write_stages = info.stages;
+                    state.write_access = info.write ? info.access : vk::AccessFlags2{};
+                    state.read_stages = info.write ? vk::PipelineStageFlags2{} : info.stages;
+                    state.visible_stages = info.write ? vk::PipelineStageFlags2{} : info.stages;
+                    state.visible_access = info.write ? vk::AccessFlags2{} : info.access;
+                    state.layout = layout;
+                } else {
+                    state.read_stages |= info.stages;
+                    if (!state.write_stages || (covers(state.visible_stages, info.stages) && covers(state.visible_access, info.access)))
+                        continue;
+                    barrier.src_stages = state.write_stages;
+                    barrier.src_access = state.write_access;
+                    state.visible_stages |= info.stages;
+                    state.visible_access |= info.access;
+                }
+
+                if (emit && (barrier.src_stages || layout_change))
+                    pass.barriers.push_back(barrier);
+            }
+        }
+    };
+
+    for (Pass& pass : m_passes)
+        pass.barriers.clear();
+    m_final_barriers.clear();
+
+    std::vector<ResourceState> states = initial_state(std::vector<ResourceState>(m_resources.size()));
+    simulate(states, false);
+    states = initial_state(states);
+    simulate(states, true);
+
+    for (ResourceId r = 0; r < m_resources.size(); ++r) {
+        const Resource& resource = m_resources[r];
+        if (!resource.imported || !resource.is_image) continue;
+
+        const ResourceState& state = states[r];
+        AccessInfo info = describe(resource.final_access);
+        if (state.layout == info.layout) continue;
+        m_final_barriers.push_back(Barrier {
+            .resource = r,
+            .src_stages = state.write_stages | state.read_stages,
+            .src_access = state.write_access,
+            .dst_stages = info.stages,
+            .dst_access = info.access,
+            .old_layout = state.layout,
+            .new_layout = info.layout
+        });
+    }
+
+    m_stats.barriers = static_cast<uint32_t>(m_final_barriers.size());
+    for (const Pass& pass : m_passes)
+        m_stats.barriers += static_cast<uint32_t>(pass.barriers.size());
+}
+
+void RenderGraph::destroy(GpuAllocator& allocator) {
+    for (Resource& resource : m_resources) {
+        if (resource.imported || !resource.image) continue;
+        m_device.destroyImageView(resource.view);
+        m_device.destroyImage(resource.image);
+    }
+    if (m_transient_memory.memory)
+        allocator.free(m_transient_memory);
+    m_transient_memory = Allocation{};
+    m_resources.clear();
+    m_passes.clear();
+    m_final_barriers.clear();
+    m_stats = RenderGraphStats{};
+}
+
+void RenderGraph::set_image(ResourceId resource, vk::Image image, vk::ImageView view) {
+    m_resources[resource].image = image;
+    m_resources[resource].view = view;
+}
+
+void RenderGraph::set_buffer(ResourceId resource, vk::Buffer buffer) {
+    m_resources[resource].buffer = buffer;
+}
+
+void RenderGraph::execute(const vk::CommandBuffer& cmd) const {
+    for (const Pass& pass : m_passes) {
+        if (!pass.live) continue;
+        record_barriers(cmd, pass.barriers);
+        pass.execute(cmd);
+    }
+    record_barriers(cmd, m_final_barriers);
+}
+
+void RenderGraph::record_barriers(const vk::CommandBuffer& cmd, const std::vector<Barrier>& barriers) const {
+    if (barriers.empty()) return;
+
+    std::vector<vk::ImageMemoryBarrier2> image_barriers;
+    std::vector<vk::BufferMemoryBarrier2> buffer_barriers;
+    for (const Barrier& barrier : barriers) {
+        const Resource& resource = m_resources[barrier.resource];
+        if (resource.is_image) {
+            image_barriers.push_back(vk::ImageMemoryBarrier2 {
+                .srcStageMask = barrier.src_stages,
+                .srcAccessMask = barrier.src_access,
+                .dstStageMask = barrier.dst_stages,
+                .dstAccessMask = barrier.dst_access,
+                .oldLayout = barrier.old_layout,
+                .newLayout = barrier.new_layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = resource.image,
+                .subresourceRange = vk::ImageSubresourceRange {
+                    .aspectMask = resource.imported ? vk::ImageAspectFlagBits::eColor : resource.desc.aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+                }
+            });
+        } else {
+            buffer_barriers.push_back(vk::BufferMemoryBarrier2 {
+                .srcStageMask = barrier.src_stages,
+                .srcAccessMask = barrier.src_access,
+                .dstStageMask = barrier.dst_stages,
+                .dstAccessMask = barrier.dst_access,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = resource.buffer,
+                .offset = 0,
+                .size = VK_WHOLE_SIZE
+            });
+        }
+    }
+
+    cmd.pipelineBarrier2(vk::DependencyInfo {
+        .bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size()),
+        .pBufferMemoryBarriers = buffer_barriers.data(),
+        .imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size()),
+        .pImageMemoryBarriers = image_barriers.data()
+    });
+}
@@ -0,0 +1,94 @@
+#include <shader_pack.hpp>
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedSpirv::MappedSpirv(const std::string& path) {
+#ifdef _WIN32
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, 
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Can't open file " + path);
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_file, &size);
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0 || m_size % sizeof(uint32_t) != 0) {
+        CloseHandle(m_file);
+        throw std::runtime_error(path + " is not a whole number of SPIR-V words");
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    m_data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!m_data) {
+        if (m_mapping) CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw std::runtime_error("Can't map file " + path);
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can't open file " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Can't stat file " + path);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size == 0 || m_size % sizeof(uint32_t) != 0) {
+        close(fd);
+        throw std::runtime_error(path + " is not a whole number of SPIR-V words");
+    }
+
+    // Fault the pages in now, so the read happens wherever the pack is loaded (a startup worker)
+    // rather than inside vkCreateShaderModule.
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void* data = mmap(nullptr, m_size, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("Can't map file " + path);
+    m_data = data;
+#endif
+
+}
+
+MappedSpirv::~MappedSpirv() {
+    if (!m_data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+#else
+    munmap(const_cast<void*>(m_data), m_size);
+#endif
+    m_data = nullptr;
+}
+
+std::span<const uint32_t> MappedSpirv::code() const {
+    return { static_cast<const uint32_t*>(m_data), m_size / sizeof(uint32_t) };
+}
+
+ShaderPack::ShaderPack(std::string directory)
+    : m_directory(std::move(directory)) {
+}
+
+std::span<const uint32_t> ShaderPack::get(const std::string& name) {
+    auto& shader = m_shaders[name];
+    if (!shader)
+        shader = std::make_unique<MappedSpirv>(m_directory + "/" + name + ".spv");
+    return shader->code();
+}
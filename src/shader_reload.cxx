@@ -0,0 +1,135 @@
+#include <shader_reload.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr uint32_t spirv_magic = 0x07230203;
+
+// The stages glslc infers from the file extension.
+bool is_shader_source(const std::filesystem::path& path) {
+    static constexpr std::array<const char*, 8> extensions = {
+        ".vert", ".frag", ".comp", ".geom", ".tesc", ".tese", ".task", ".mesh"
+    };
+    std::string extension = path.extension().string();
+    return std::find(extensions.begin(), extensions.end(), extension) != extensions.end();
+}
+
+// Sources that exist now, with their last write time. Files that vanish or can't be stat'ed
+// mid-save are skipped and picked up on a later poll.
+std::map<std::filesystem::path, std::filesystem::file_time_type> scan(const std::filesystem::path& directory) {
+    std::map<std::filesystem::path, std::filesystem::file_time_type> write_times;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (!entry.is_regular_file(error) || !is_shader_source(entry.path()))
+            continue;
+        auto time = entry.last_write_time(error);
+        if (!error)
+            write_times.emplace(entry.path(), time);
+    }
+    return write_times;
+}
+
+std::string quote(const std::string& text) {
+    return "\"" + text + "\"";
+}
+
+}
+
+void ShaderReloader::start(std::filesystem::path source_dir, std::string compiler, Rebuild rebuild) {
+    stop();
+
+    m_source_dir = std::move(source_dir);
+    m_compiler = std::move(compiler);
+    m_rebuild = std::move(rebuild);
+    m_output_dir = std::filesystem::temp_directory_path() / "shader_reload";
+    std::filesystem::create_directories(m_output_dir);
+    m_write_times = scan(m_source_dir);
+    if (m_write_times.empty())
+        std::cerr << "No shader sources in " << m_source_dir.string() << " to watch\n";
+
+    m_stop = false;
+    m_thread = std::thread(&ShaderReloader::watch, this);
+}
+
+void ShaderReloader::stop() {
+    if (!m_thread.joinable()) return;
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+ShaderReloadStats ShaderReloader::stats() const {
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+void ShaderReloader::watch() {
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_cv.wait_for(lock, poll_interval, [this]() { return m_stop; }))
+                return;
+        }
+
+        ShaderChanges changed;
+        for (const auto& [path, time] : scan(m_source_dir)) {
+            auto known = m_write_times.find(path);
+            if (known != m_write_times.end() && known->second == time)
+                continue;
+            m_write_times[path] = time;
+
+            std::vector<uint32_t> code;
+            bool compiled = compile(path, code);
+            {
+                std::lock_guard lock(m_mutex);
+                ++(compiled ? m_stats.compiled : m_stats.failed);
+            }
+            if (compiled)
+                changed.emplace(path.filename().string(), std::move(code));
+        }
+
+        if (!changed.empty())
+            m_rebuild(changed);
+    }
+}
+
+bool ShaderReloader::compile(const std::filesystem::path& source, std::vector<uint32_t>& code) {
+    std::filesystem::path output = m_output_dir / (source.filename().string() + ".spv");
+    std::filesystem::path log = m_output_dir / (source.filename().string() + ".log");
+    std::filesystem::remove(output);
+
+    std::string command = quote(m_compiler) + " " + quote(source.string()) + " -o " + quote(output.string())
+                        + " 2> " + quote(log.string());
+#ifdef _WIN32
+    // cmd.exe strips the outer pair of quotes when the command starts with one.
+    command = quote(command);
+#endif
+    if (std::system(command.c_str()) != 0) {
+        std::ifstream log_file(log);
+        std::cerr << "Failed to compile " << source.filename().string() << ":\n" << log_file.rdbuf();
+        return false;
+    }
+
+    std::ifstream file(output, std::ios::binary | std::ios::ate);
+    size_t size = file ? static_cast<size_t>(file.tellg()) : 0;
+    if (size == 0 || size % sizeof(uint32_t) != 0) {
+        std::cerr << output.string() << " is not a whole number of SPIR-V words\n";
+        return false;
+    }
+    code.resize(size / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(code.data()), size);
+    if (!file || code.front() != spirv_magic) {
+        std::cerr << output.string() << " is not SPIR-V\n";
+        return false;
+    }
+    return true;
+}
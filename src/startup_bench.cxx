@@ -0,0 +1,128 @@
+#include <application.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Runs the headless init sequence repeatedly and reports per-stage startup cost as JSON.
+// Usage: startup_bench [--repetitions N] [--warmup N] [--device NAME] [--warm-cache PATH] [--out FILE]
+// Point VK_DRIVER_FILES (or VK_ICD_FILENAMES) at a software ICD such as lavapipe to run without a GPU.
+
+namespace {
+
+struct Summary {
+    double mean = 0.0;
+    double median = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+};
+
+Summary summarize(std::vector<double> samples) {
+    Summary summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double sample : samples)
+        sum += sample;
+    summary.mean = sum / samples.size();
+
+    size_t mid = samples.size() / 2;
+    summary.median = samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2.0;
+
+    double variance = 0.0;
+    for (double sample : samples)
+        variance += (sample - summary.mean) * (sample - summary.mean);
+    summary.stddev = samples.size() > 1 ? std::sqrt(variance / (samples.size() - 1)) : 0.0;
+
+    summary.min = samples.front();
+    summary.max = samples.back();
+    return summary;
+}
+
+void write_summary(std::ostream& out, const Summary& summary) {
+    out << "{\"mean_ms\":" << summary.mean
+        << ",\"median_ms\":" << summary.median
+        << ",\"stddev_ms\":" << summary.stddev
+        << ",\"min_ms\":" << summary.min
+        << ",\"max_ms\":" << summary.max << "}";
+}
+
+}
+
+int main(int argc, char** argv) {
+    uint32_t repetitions = 10;
+    uint32_t warmup = 2;
+    std::string out_path;
+
+    ApplicationConfig config;
+    config.headless = true;
+    config.use_headless_surface = false;
+    config.pipeline_cache_path.clear();
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            config.device_name = argv[++i];
+        } else if (strcmp(argv[i], "--warm-cache") == 0 && i + 1 < argc) {
+            config.pipeline_cache_path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        }
+    }
+
+    std::vector<std::string> stage_order;
+    std::map<std::string, std::vector<double>> stage_samples;
+    std::vector<double> total_samples;
+
+    for (uint32_t run = 0; run < warmup + repetitions; ++run) {
+        Application app(config);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            app.init();
+        } catch (std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return EXIT_FAILURE;
+        }
+        // Wall time rather than the sum of stages, since some stages run concurrently.
+        double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (run >= warmup) {
+            for (const auto& stage : app.init_stage_times()) {
+                if (!stage_samples.count(stage.name))
+                    stage_order.push_back(stage.name);
+                stage_samples[stage.name].push_back(stage.ms);
+            }
+            total_samples.push_back(total);
+        }
+
+        app.cleanup();
+    }
+
+    std::ofstream file;
+    if (!out_path.empty())
+        file.open(out_path, std::ios::trunc);
+    std::ostream& out = out_path.empty() ? std::cout : file;
+
+    out << "{\"repetitions\":" << repetitions << ",\"warmup\":" << warmup << ",\"stages\":[";
+    for (size_t i = 0; i < stage_order.size(); ++i) {
+        out << (i ? "," : "") << "\n  {\"name\":\"" << stage_order[i] << "\",\"summary\":";
+        write_summary(out, summarize(stage_samples[stage_order[i]]));
+        out << "}";
+    }
+    out << "\n],\"total\":";
+    write_summary(out, summarize(total_samples));
+    out << "}\n";
+
+    return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}
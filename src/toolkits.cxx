@@ -1,35 +1,52 @@
 #include <toolkits.hpp>
 #include <iostream>
 #include <fstream>
-#include <set>
+#include <cstring>
+#include <algorithm>
 
 PFN_vkCreateDebugUtilsMessengerEXT pfnVkCreateDebugUtilsMessengerEXT;
 PFN_vkDestroyDebugUtilsMessengerEXT pfnVkDestroyDebugUtilsMessengerEXT;
+PFN_vkCreateHeadlessSurfaceEXT pfnVkCreateHeadlessSurfaceEXT;
+PFN_vkWaitForPresentKHR pfnVkWaitForPresentKHR;
 
-QueueFamilyIndices QueueFamilyIndices::find_queue_families(const vk::PhysicalDevice& phy_device, const vk::SurfaceKHR& surface) {
+QueueFamilyIndices QueueFamilyIndices::find_queue_families(const vk::PhysicalDevice& phy_device,
+                                                           std::span<const vk::QueueFamilyProperties> queue_families,
+                                                           const vk::SurfaceKHR& surface) {
     QueueFamilyIndices indices;
 
-    std::vector<vk::QueueFamilyProperties> queue_families
-        = phy_device.getQueueFamilyProperties();
+    // Every family is visited: graphics prefers a family that can also present, compute prefers a
+    // family without graphics, and transfer prefers one with neither, i.e. a DMA engine.
+    for (uint32_t idx = 0; idx < queue_families.size(); ++idx) {
+        vk::QueueFlags flags = queue_families[idx].queueFlags;
+        bool graphics = static_cast<bool>(flags & vk::QueueFlagBits::eGraphics);
+        bool compute = static_cast<bool>(flags & vk::QueueFlagBits::eCompute);
+        bool transfer = static_cast<bool>(flags & vk::QueueFlagBits::eTransfer);
+
+        bool present = false;
+        if (surface) {
+            vk::Bool32 support;
+            auto result = phy_device.getSurfaceSupportKHR(idx, surface, &support);
+            present = result == vk::Result::eSuccess && support;
+        }
 
-    uint32_t idx = 0;
-    for (const auto& queue_family : queue_families) {
-        if (queue_family.queueFlags & vk::QueueFlagBits::eGraphics) {
+        if (graphics && (!indices.graphics || (present && indices.graphics != indices.present)))
             indices.graphics = idx;
-        }
-        
-        vk::Bool32 support;
-        auto result = phy_device.getSurfaceSupportKHR(idx, surface, &support);
-        if (support) {
+        if (present && (!indices.present || indices.present != indices.graphics))
             indices.present = idx;
-        }
 
-        if (indices.satisfied_all())
-            break;
-            
-        ++idx;
+        if (compute && !graphics && !indices.compute)
+            indices.compute = idx;
+        if (transfer && !graphics && !compute && !indices.transfer)
+            indices.transfer = idx;
     }
 
+    if (!surface)
+        indices.present = indices.graphics;
+
+    // Without a DMA-only family an async compute family still takes uploads off the graphics queue.
+    if (!indices.transfer)
+        indices.transfer = indices.compute;
+
     return indices;
 }
 
@@ -49,6 +66,18 @@ VKAPI_ATTR void VKAPI_CALL vkDestroyDebugUtilsMessengerEXT(VkInstance instance,
     return pfnVkDestroyDebugUtilsMessengerEXT(instance, messenger, pAllocator);
 }
 
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateHeadlessSurfaceEXT(VkInstance instance,
+                                                          const VkHeadlessSurfaceCreateInfoEXT *pCreateInfo,
+                                                          const VkAllocationCallbacks *pAllocator,
+                                                          VkSurfaceKHR *pSurface) {
+    return pfnVkCreateHeadlessSurfaceEXT(instance, pCreateInfo, pAllocator, pSurface);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForPresentKHR(VkDevice device, VkSwapchainKHR swapchain,
+                                                   uint64_t presentId, uint64_t timeout) {
+    return pfnVkWaitForPresentKHR(device, swapchain, presentId, timeout);
+}
+
 void VkToolMakeDebugUtilsMessengerEXT(const vk::Instance& inst) {
     pfnVkCreateDebugUtilsMessengerEXT 
         = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
@@ -58,6 +87,18 @@ void VkToolMakeDebugUtilsMessengerEXT(const vk::Instance& inst) {
         inst.getProcAddr("vkDestroyDebugUtilsMessengerEXT"));
 }
 
+void VkToolMakeHeadlessSurfaceEXT(const vk::Instance& inst) {
+    pfnVkCreateHeadlessSurfaceEXT
+        = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+        inst.getProcAddr("vkCreateHeadlessSurfaceEXT"));
+}
+
+void VkToolMakePresentWaitKHR(const vk::Device& device) {
+    pfnVkWaitForPresentKHR
+        = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+        device.getProcAddr("vkWaitForPresentKHR"));
+}
+
 bool check_validation_layers() {
     uint32_t layer_count = 0;
     auto available_layers = vk::enumerateInstanceLayerProperties();
@@ -79,10 +120,29 @@ bool check_validation_layers() {
     return true;
 }
 
-std::vector<const char*> get_required_extensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+bool check_instance_extension_support(const char* extension_name) {
+    auto available_extensions = vk::enumerateInstanceExtensionProperties();
+
+    for (const auto& extension : available_extensions) {
+        if (strcmp(extension_name, extension.extensionName) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+std::vector<const char*> get_required_extensions(bool headless, bool use_headless_surface) {
+    std::vector<const char*> extensions;
+
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    } else if (use_headless_surface 
+               && check_instance_extension_support(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+    }
 
     if (enable_validation_layers) 
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -96,16 +156,24 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
     const VkDebugUtilsMessengerCallbackDataEXT* p_callback_data,
     void* p_user_data) {
 
-    if (severity > VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)    
+    if (p_user_data)
+        static_cast<DebugMessageSink*>(p_user_data)->push(severity, type, p_callback_data);
+    else if (severity > VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)    
         std::cerr << "Validation layer: " << p_callback_data->pMessage << "\n";
 
     return false;
 }
 
-vk::DebugUtilsMessengerCreateInfoEXT get_messenger_create_info() {
+// Info and verbose messages are left out unless the sink prints them: the layers emit them on
+// every call, and even counting them costs more than the timing runs can afford.
+vk::DebugUtilsMessengerCreateInfoEXT get_messenger_create_info(DebugMessageSink* sink) {
     vk::DebugUtilsMessageSeverityFlagsEXT severity(vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning | 
-                                                   vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose | 
                                                    vk::DebugUtilsMessageSeverityFlagBitsEXT::eError);
+    VkDebugUtilsMessageSeverityFlagBitsEXT lowest = sink ? sink->min_printed() : VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+    if (lowest <= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+        severity |= vk::DebugUtilsMessageSeverityFlagBitsEXT::eInfo;
+    if (lowest <= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT)
+        severity |= vk::DebugUtilsMessageSeverityFlagBitsEXT::eVerbose;
 
     vk::DebugUtilsMessageTypeFlagsEXT type(vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral | 
                                            vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation | 
@@ -115,30 +183,151 @@ vk::DebugUtilsMessengerCreateInfoEXT get_messenger_create_info() {
             .setMessageSeverity(severity)
             .setMessageType(type)
             .setPfnUserCallback(debug_callback)
-            .setPUserData(nullptr);
+            .setPUserData(sink);
 }
 
-bool is_device_suitable(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface) {
-// bool is_device_suitable(const vk::PhysicalDevice& device) {
-    QueueFamilyIndices indices = QueueFamilyIndices::find_queue_families(device, surface);
-    bool extensions_support = check_device_extensions_support(device);
-    bool swapchain_adequate = false;
-    if (extensions_support) {
-        SwapChainSupportDetails support = query_swapchain_support(device, surface);
-        swapchain_adequate = !support.formats.empty() && !support.present_modes.empty();     
+DeviceCapabilities DeviceCapabilities::query(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface) {
+    DeviceCapabilities caps {
+        .device = device,
+        .properties = device.getProperties(),
+        .memory_properties = device.getMemoryProperties(),
+        .extensions = device.enumerateDeviceExtensionProperties(),
+        .queue_family_properties = device.getQueueFamilyProperties()
+    };
+    caps.queue_families = QueueFamilyIndices::find_queue_families(device, caps.queue_family_properties, surface);
+
+    // Left all false below Vulkan 1.2, which is_device_suitable() rejects.
+    if (caps.properties.apiVersion >= VK_API_VERSION_1_2) {
+        vk::PhysicalDeviceProperties2 properties2 { .pNext = &caps.vulkan12_properties };
+        device.getProperties2(&properties2);
+        caps.vulkan12_properties.pNext = nullptr;
+    }
+
+    // One query fills every feature struct the device's version and extensions cover.
+    bool present_wait_extensions = caps.has_extension(VK_KHR_PRESENT_ID_EXTENSION_NAME)
+                                && caps.has_extension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    if (caps.properties.apiVersion >= VK_API_VERSION_1_1) {
+        vk::PhysicalDeviceFeatures2 features2;
+        vk::PhysicalDevicePresentIdFeaturesKHR present_id_features;
+        vk::PhysicalDevicePresentWaitFeaturesKHR present_wait_features;
+        void** next = &features2.pNext;
+        auto chain = [&next](auto& features) {
+            *next = &features;
+            next = &features.pNext;
+        };
+        if (caps.properties.apiVersion >= VK_API_VERSION_1_2)
+            chain(caps.vulkan12_features);
+        if (caps.properties.apiVersion >= VK_API_VERSION_1_3)
+            chain(caps.vulkan13_features);
+        if (present_wait_extensions) {
+            chain(present_id_features);
+            chain(present_wait_features);
+        }
+        device.getFeatures2(&features2);
+
+        caps.features = features2.features;
+        caps.vulkan12_features.pNext = nullptr;
+        caps.vulkan13_features.pNext = nullptr;
+        caps.present_wait = present_id_features.presentId && present_wait_features.presentWait;
+    } else {
+        caps.features = device.getFeatures();
     }
-    return indices.satisfied_all() && extensions_support && swapchain_adequate;
-}
 
-bool check_device_extensions_support(const vk::PhysicalDevice& device) {
-    auto extensions = device.enumerateDeviceExtensionProperties();
+    caps.memory_budget = caps.has_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
-    std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
+    if (surface && check_device_extensions_support(caps))
+        caps.swapchain_support = query_swapchain_support(device, surface);
+
+    return caps;
+}
+
+bool DeviceCapabilities::has_extension(const char* extension_name) const {
     for (const auto& extension : extensions) {
-        required_extensions.erase(extension.extensionName);
+        if (strcmp(extension_name, extension.extensionName) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool is_device_suitable(const DeviceCapabilities& caps, const vk::SurfaceKHR& surface) {
+    // Uploads, frame pacing and GPU tasks all synchronize on timeline semaphores, and the
+    // Vulkan12Features struct they are enabled through needs a 1.2 device.
+    if (caps.properties.apiVersion < VK_API_VERSION_1_2 || !caps.vulkan12_features.timelineSemaphore)
+        return false;
+    if (!surface)
+        return caps.queue_families.satisfied_all();
+
+    bool swapchain_adequate = !caps.swapchain_support.formats.empty() 
+                           && !caps.swapchain_support.present_modes.empty();
+    return caps.queue_families.satisfied_all() && check_device_extensions_support(caps) && swapchain_adequate;
+}
+
+uint64_t rate_device(const DeviceCapabilities& caps) {
+    const vk::PhysicalDeviceProperties& properties = caps.properties;
+    const vk::PhysicalDeviceFeatures& features = caps.features;
+    const vk::PhysicalDeviceMemoryProperties& memory = caps.memory_properties;
+
+    // The device type is the primary key: it lives above every bit the other terms can reach,
+    // so no amount of memory lets an integrated or CPU device outrank a discrete GPU.
+    uint64_t tier = 0;
+    switch (properties.deviceType) {
+        case vk::PhysicalDeviceType::eDiscreteGpu:   tier = 4; break;
+        case vk::PhysicalDeviceType::eIntegratedGpu: tier = 3; break;
+        case vk::PhysicalDeviceType::eVirtualGpu:    tier = 2; break;
+        case vk::PhysicalDeviceType::eCpu:           tier = 1; break;
+        default: break;
+    }
+
+    uint64_t score = 0;
+
+    // One point per MiB of the largest device-local heap.
+    vk::DeviceSize device_local = 0;
+    for (uint32_t i = 0; i < memory.memoryHeapCount; ++i) {
+        if (memory.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+            device_local = std::max(device_local, memory.memoryHeaps[i].size);
+    }
+    score += device_local >> 20;
+
+    score += properties.limits.maxImageDimension2D / 16;
+    score += properties.limits.maxComputeWorkGroupInvocations / 16;
+
+    const vk::Bool32 wanted_features[] = {
+        features.multiDrawIndirect,
+        features.drawIndirectFirstInstance,
+        features.samplerAnisotropy,
+        features.shaderInt64,
+        features.pipelineStatisticsQuery
+    };
+    for (auto feature : wanted_features) {
+        if (feature)
+            score += 1000;
+    }
+
+    constexpr uint64_t tier_shift = 48;
+    return (tier << tier_shift) | std::min(score, (uint64_t(1) << tier_shift) - 1);
+}
+
+bool check_device_extensions_support(const DeviceCapabilities& caps) {
+    for (const char* extension_name : device_extensions) {
+        if (!caps.has_extension(extension_name))
+            return false;
     }
+    return true;
+}
 
-    return required_extensions.empty();
+uint32_t find_memory_type(const vk::PhysicalDevice& phy_device, uint32_t type_bits, vk::MemoryPropertyFlags properties) {
+    return find_memory_type(phy_device.getMemoryProperties(), type_bits, properties);
+}
+
+uint32_t find_memory_type(const vk::PhysicalDeviceMemoryProperties& memory_properties, uint32_t type_bits, vk::MemoryPropertyFlags properties) {
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+        if ((type_bits & (1u << i)) 
+            && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Can't find a suitable memory type");
 }
 
 SwapChainSupportDetails query_swapchain_support(const vk::PhysicalDevice& phy_device, const vk::SurfaceKHR& surface) {
@@ -159,27 +348,30 @@ vk::SurfaceFormatKHR choose_surface_format(const std::vector<vk::SurfaceFormatKH
     return formats[0];
 }
 
-vk::PresentModeKHR choose_present_mode(const std::vector<vk::PresentModeKHR>& modes) {
+vk::PresentModeKHR choose_present_mode(const std::vector<vk::PresentModeKHR>& modes, vk::PresentModeKHR preferred) {
     for (const auto& mode : modes) {
-        if (mode == vk::PresentModeKHR::eMailbox)
+        if (mode == preferred)
             return mode;
     }
     return vk::PresentModeKHR::eFifo;
 }
 
-vk::Extent2D choose_extent(const vk::SurfaceCapabilitiesKHR& capabilities, GLFWwindow* window) {
+vk::Extent2D choose_extent(const vk::SurfaceCapabilitiesKHR& capabilities, GLFWwindow* window, vk::Extent2D headless_extent) {
     // auto max = std::numeric_limits<uint32_t>::max();
     if (capabilities.currentExtent.width 
         != (std::numeric_limits<uint32_t>::max)()) {
             // != 0) {
         return capabilities.currentExtent;
     } else {
-        int32_t width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-        vk::Extent2D extent {
-            static_cast<uint32_t>(width),
-            static_cast<uint32_t>(height)
-        };
+        vk::Extent2D extent = headless_extent;
+        if (window) {
+            int32_t width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            extent = vk::Extent2D {
+                static_cast<uint32_t>(width),
+                static_cast<uint32_t>(height)
+            };
+        }
         extent.width = std::clamp(extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
         extent.height = std::clamp(extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
         return extent;
@@ -198,10 +390,10 @@ std::vector<char> read_file(const char* filename) {
     return buffer;
 }
 
-vk::ShaderModule create_shader_module(const vk::Device& device, const std::vector<char>& buffer) {
+vk::ShaderModule create_shader_module(const vk::Device& device, std::span<const uint32_t> code) {
     vk::ShaderModuleCreateInfo sm_create_info {
-        .codeSize = buffer.size(),
-        .pCode = reinterpret_cast<const uint32_t*>(buffer.data())
+        .codeSize = code.size_bytes(),
+        .pCode = code.data()
     };
 
     return device.createShaderModule(sm_create_info);
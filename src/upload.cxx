@@ -0,0 +1,298 @@
+#include <upload.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+constexpr vk::DeviceSize upload_chunk_size = 16 * 1024 * 1024;
+
+constexpr vk::PipelineStageFlags consumer_stages = upload_consumer_stages;
+
+constexpr vk::AccessFlags consumer_access = vk::AccessFlagBits::eIndirectCommandRead
+                                          | vk::AccessFlagBits::eIndexRead
+                                          | vk::AccessFlagBits::eVertexAttributeRead
+                                          | vk::AccessFlagBits::eUniformRead
+                                          | vk::AccessFlagBits::eShaderRead;
+
+constexpr vk::ImageSubresourceRange color_range {
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1
+};
+
+}
+
+void UploadService::init(const vk::Device& device, const DeviceCapabilities& caps, GpuAllocator& allocator,
+                         const vk::Queue& transfer_queue, uint32_t transfer_family, uint32_t graphics_family,
+                         vk::DeviceSize staging_size) {
+    m_device = device;
+    m_allocator = &allocator;
+    m_queue = transfer_queue;
+    m_transfer_family = transfer_family;
+    m_graphics_family = graphics_family;
+    m_alignment = std::max<vk::DeviceSize>(16, caps.properties.limits.optimalBufferCopyOffsetAlignment);
+
+    m_command_pool = m_device.createCommandPool(vk::CommandPoolCreateInfo {
+        .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient,
+        .queueFamilyIndex = m_transfer_family
+    });
+
+    vk::SemaphoreTypeCreateInfo timeline_info {
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue = 0
+    };
+    m_timeline = m_device.createSemaphore(vk::SemaphoreCreateInfo { .pNext = &timeline_info });
+
+    vk::BufferCreateInfo staging_create_info {
+        .size = staging_size,
+        .usage = vk::BufferUsageFlagBits::eTransferSrc,
+        .sharingMode = vk::SharingMode::eExclusive
+    };
+    m_staging = allocator.create_buffer(staging_create_info, 
+                                        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    m_staging_size = staging_size;
+}
+
+void UploadService::destroy() {
+    if (!m_device) return;
+
+    wait(m_submitted_value);
+    m_allocator->destroy_buffer(m_staging);
+    m_device.destroySemaphore(m_timeline);
+    m_device.destroyCommandPool(m_command_pool);
+    m_device = nullptr;
+}
+
+vk::DeviceSize UploadService::reserve(vk::DeviceSize size) {
+    if (size > m_staging_size)
+        throw std::runtime_error("Upload is larger than the staging ring");
+
+    while (true) {
+        reclaim();
+
+        vk::DeviceSize offset = (m_head % m_staging_size + m_alignment - 1) / m_alignment * m_alignment;
+        vk::DeviceSize position = m_head - m_head % m_staging_size + offset;
+        if (offset + size > m_staging_size)
+            position = (m_head / m_staging_size + 1) * m_staging_size;
+
+        if (position + size - m_tail <= m_staging_size) {
+            m_head = position + size;
+            return position % m_staging_size;
+        }
+
+        // The ring is full: push out what we have and wait for the oldest batch to retire.
+        if (m_recording)
+            submit_locked();
+        if (m_in_flight.empty())
+            throw std::runtime_error("Staging ring exhausted");
+        wait(m_in_flight.front().value);
+    }
+}
+
+void UploadService::reclaim() {
+    uint64_t completed = m_device.getSemaphoreCounterValue(m_timeline);
+    while (!m_in_flight.empty() && m_in_flight.front().value <= completed) {
+        m_tail = m_in_flight.front().ring_end;
+        m_free_cmds.push_back(m_in_flight.front().cmd);
+        m_in_flight.pop_front();
+    }
+}
+
+void UploadService::begin_batch() {
+    if (m_recording) return;
+
+    if (m_free_cmds.empty()) {
+        vk::CommandBufferAllocateInfo alloc_info {
+            .commandPool = m_command_pool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = 1
+        };
+        m_recording = m_device.allocateCommandBuffers(alloc_info).front();
+    } else {
+        m_recording = m_free_cmds.back();
+        m_free_cmds.pop_back();
+        m_recording.reset();
+    }
+
+    m_recording.begin(vk::CommandBufferBeginInfo { .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+}
+
+void UploadService::upload_buffer_chunked(const vk::Buffer& dst, vk::DeviceSize dst_offset, const void* data,
+                                          vk::DeviceSize size) {
+    const std::byte* bytes = static_cast<const std::byte*>(data);
+    for (vk::DeviceSize offset = 0; offset < size; offset += upload_chunk_size)
+        upload_buffer(dst, dst_offset + offset, bytes + offset, std::min(upload_chunk_size, size - offset));
+}
+
+void UploadService::upload_buffer(const vk::Buffer& dst, vk::DeviceSize dst_offset, const void* data, vk::DeviceSize size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    vk::DeviceSize staging_offset = reserve(size);
+    memcpy(static_cast<char*>(m_staging.allocation.mapped) + staging_offset, data, size);
+
+    begin_batch();
+    m_recording.copyBuffer(m_staging.buffer, dst, vk::BufferCopy {
+        .srcOffset = staging_offset,
+        .dstOffset = dst_offset,
+        .size = size
+    });
+
+    if (m_transfer_family == m_graphics_family) return;
+
+    vk::BufferMemoryBarrier release {
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlags{},
+        .srcQueueFamilyIndex = m_transfer_family,
+        .dstQueueFamilyIndex = m_graphics_family,
+        .buffer = dst,
+        .offset = dst_offset,
+        .size = size
+    };
+    m_recording.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, 
+                                vk::DependencyFlags{}, nullptr, release, nullptr);
+
+    vk::BufferMemoryBarrier acquire = release;
+    acquire.setSrcAccessMask(vk::AccessFlags{}).setDstAccessMask(consumer_access);
+    m_pending_buffer_acquires.push_back(acquire);
+}
+
+void UploadService::upload_image(const vk::Image& dst, vk::Extent3D extent, const void* data, vk::DeviceSize size,
+                                 vk::ImageLayout final_layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    vk::DeviceSize staging_offset = reserve(size);
+    memcpy(static_cast<char*>(m_staging.allocation.mapped) + staging_offset, data, size);
+
+    begin_batch();
+    vk::ImageMemoryBarrier to_transfer {
+        .srcAccessMask = vk::AccessFlags{},
+        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eTransferDstOptimal,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = dst,
+        .subresourceRange = color_range
+    };
+    m_recording.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                                vk::DependencyFlags{}, nullptr, nullptr, to_transfer);
+
+    m_recording.copyBufferToImage(m_staging.buffer, dst, vk::ImageLayout::eTransferDstOptimal, vk::BufferImageCopy {
+        .bufferOffset = staging_offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = vk::ImageSubresourceLayers {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .imageOffset = vk::Offset3D { 0, 0, 0 },
+        .imageExtent = extent
+    });
+
+    // The release and the acquire must describe the same layout transition.
+    bool transfer_ownership = m_transfer_family != m_graphics_family;
+    vk::ImageMemoryBarrier release {
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = transfer_ownership ? vk::AccessFlags{} : consumer_access,
+        .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+        .newLayout = final_layout,
+        .srcQueueFamilyIndex = transfer_ownership ? m_transfer_family : VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = transfer_ownership ? m_graphics_family : VK_QUEUE_FAMILY_IGNORED,
+        .image = dst,
+        .subresourceRange = color_range
+    };
+    m_recording.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, 
+                                transfer_ownership ? vk::PipelineStageFlagBits::eBottomOfPipe : consumer_stages,
+                                vk::DependencyFlags{}, nullptr, nullptr, release);
+
+    if (!transfer_ownership) return;
+
+    vk::ImageMemoryBarrier acquire = release;
+    acquire.setSrcAccessMask(vk::AccessFlags{}).setDstAccessMask(consumer_access);
+    m_pending_image_acquires.push_back(acquire);
+}
+
+uint64_t UploadService::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_recording)
+        return m_submitted_value;
+    return submit_locked();
+}
+
+uint64_t UploadService::submit_locked() {
+    m_recording.end();
+
+    uint64_t value = m_submitted_value + 1;
+    vk::TimelineSemaphoreSubmitInfo timeline_submit_info {
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value
+    };
+    vk::SubmitInfo submit_info {
+        .pNext = &timeline_submit_info,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &m_recording,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &m_timeline
+    };
+    m_queue.submit(submit_info);
+
+    m_in_flight.push_back(Batch { .cmd = m_recording, .value = value, .ring_end = m_head });
+    m_recording = nullptr;
+    m_submitted_value = value;
+
+    m_buffer_acquires.insert(m_buffer_acquires.end(), m_pending_buffer_acquires.begin(), m_pending_buffer_acquires.end());
+    m_image_acquires.insert(m_image_acquires.end(), m_pending_image_acquires.begin(), m_pending_image_acquires.end());
+    m_pending_buffer_acquires.clear();
+    m_pending_image_acquires.clear();
+    m_acquire_value = value;
+    return value;
+}
+
+bool UploadService::is_complete(uint64_t value) const {
+    return m_device.getSemaphoreCounterValue(m_timeline) >= value;
+}
+
+void UploadService::wait(uint64_t value) const {
+    vk::SemaphoreWaitInfo wait_info {
+        .semaphoreCount = 1,
+        .pSemaphores = &m_timeline,
+        .pValues = &value
+    };
+    if (m_device.waitSemaphores(wait_info, UINT64_MAX) != vk::Result::eSuccess)
+        throw std::runtime_error("Failed to wait for upload timeline");
+}
+
+uint64_t UploadService::record_acquires(const vk::CommandBuffer& cmd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_buffer_acquires.empty() || !m_image_acquires.empty()) {
+        // Chained after the timeline wait, which the graphics submission performs at consumer_stages.
+        cmd.pipelineBarrier(consumer_stages, consumer_stages, vk::DependencyFlags{},
+                            nullptr, m_buffer_acquires, m_image_acquires);
+        m_buffer_acquires.clear();
+        m_image_acquires.clear();
+        return m_acquire_value;
+    }
+
+    if (m_acquire_value == 0) return 0;
+    if (m_device.getSemaphoreCounterValue(m_timeline) >= m_acquire_value) {
+        m_acquire_value = 0;
+        return 0;
+    }
+    if (m_transfer_family != m_graphics_family) {
+        // Until the batch completes, this frame may overlap the one that acquired it; chain onto
+        // that frame's acquire barrier, recorded earlier on this queue.
+        vk::MemoryBarrier chain {
+            .srcAccessMask = vk::AccessFlags{},
+            .dstAccessMask = consumer_access
+        };
+        cmd.pipelineBarrier(consumer_stages, consumer_stages, vk::DependencyFlags{}, chain, nullptr, nullptr);
+    }
+    return m_acquire_value;
+}
@@ -0,0 +1,98 @@
+#include <work_stealing.hpp>
+
+#include <algorithm>
+
+WorkStealingScheduler::WorkStealingScheduler(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    for (size_t i = 0; i < thread_count; ++i)
+        m_threads.emplace_back(&WorkStealingScheduler::worker, this, static_cast<uint32_t>(i));
+}
+
+WorkStealingScheduler::~WorkStealingScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void WorkStealingScheduler::parallel_for(uint32_t slice_count, Job job) {
+    if (slice_count == 0) return;
+
+    // The job is published before any slice; a worker only reads it after popping one.
+    m_job = std::move(job);
+    m_error = nullptr;
+    m_remaining.store(slice_count);
+
+    for (uint32_t slice = 0; slice < slice_count; ++slice) {
+        WorkQueue& queue = *m_queues[slice % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.slices.push_back(slice);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_generation;
+    }
+    m_work_cv.notify_all();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this]() { return m_remaining.load() == 0; });
+
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+bool WorkStealingScheduler::pop(uint32_t worker, uint32_t& slice) {
+    WorkQueue& queue = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.slices.empty())
+        return false;
+    slice = queue.slices.back();
+    queue.slices.pop_back();
+    return true;
+}
+
+bool WorkStealingScheduler::steal(uint32_t worker, uint32_t& slice) {
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        WorkQueue& queue = *m_queues[(worker + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.slices.empty()) {
+            slice = queue.slices.front();
+            queue.slices.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingScheduler::worker(uint32_t index) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_work_cv.wait(lock, [&]() { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+        }
+
+        uint32_t slice;
+        while (pop(index, slice) || steal(index, slice)) {
+            try {
+                m_job(index, slice);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error) m_error = std::current_exception();
+            }
+
+            if (m_remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done_cv.notify_all();
+            }
+        }
+    }
+}